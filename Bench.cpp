@@ -0,0 +1,694 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "sources/BulkLoad.hpp"
+#include "sources/Codec.hpp"
+#include "sources/DurableMagicalContainer.hpp"
+#include "sources/MagicalContainer.hpp"
+#include "sources/Reductions.hpp"
+
+using namespace ariel;
+using namespace std;
+
+namespace {
+
+    using Clock = chrono::steady_clock;
+
+    // Keeps the optimizer from discarding the work being measured.
+    volatile long long sink = 0;
+
+    // One benchmark across all repetitions; samples holds ns per operation of each run.
+    struct Result {
+        string name;
+        string impl;
+        string distribution;
+        size_t size = 0;
+        size_t ops = 0;
+        vector<double> samples;
+        double median = 0;
+        double ciLow = 0;
+        double ciHigh = 0;
+    };
+
+    vector<Result> results;
+    map<string, size_t> resultIndex;
+
+    string keyOf(const string &name, const string &impl, const string &distribution, size_t size) {
+        return name + "|" + impl + "|" + distribution + "|" + to_string(size);
+    }
+
+    void record(const string &name, const string &impl, const string &distribution, size_t size, size_t ops,
+                Clock::duration elapsed) {
+        double nanos = static_cast<double>(chrono::duration_cast<chrono::nanoseconds>(elapsed).count());
+        string key = keyOf(name, impl, distribution, size);
+        auto found = resultIndex.find(key);
+        if (found == resultIndex.end()) {
+            found = resultIndex.emplace(key, results.size()).first;
+            results.push_back({name, impl, distribution, size, ops, {}});
+        }
+        results[found->second].samples.push_back(ops == 0 ? 0.0 : nanos / static_cast<double>(ops));
+    }
+
+    // Median with a distribution-free ~95% confidence interval built from order statistics:
+    // the widest symmetric pair of ranks whose binomial(n, 1/2) coverage is still >= 95%,
+    // or the full sample range when there are too few repetitions to reach it.
+    void summarize(Result &res) {
+        vector<double> sorted = res.samples;
+        sort(sorted.begin(), sorted.end());
+        size_t count = sorted.size();
+        res.median = count % 2 == 1 ? sorted[count / 2] : (sorted[count / 2 - 1] + sorted[count / 2]) / 2;
+
+        vector<double> cdf(count + 1);
+        double term = pow(0.5, static_cast<double>(count));
+        double running = 0;
+        for (size_t k = 0; k <= count; ++k) {
+            running += term;
+            cdf[k] = running;
+            term = term * static_cast<double>(count - k) / static_cast<double>(k + 1);
+        }
+        size_t low = 0;
+        // Coverage of [sorted[j], sorted[n-1-j]] is 1 - 2 * P(X <= j).
+        while (low + 1 < count / 2 && 1.0 - 2.0 * cdf[low + 1] >= 0.95) {
+            ++low;
+        }
+        res.ciLow = sorted[low];
+        res.ciHigh = sorted[count - 1 - low];
+    }
+
+    // Value distributions the container is filled with.
+    vector<int> makeValues(const string &distribution, size_t size, unsigned seed) {
+        mt19937 rng(seed);
+        vector<int> values(size);
+        if (distribution == "uniform") {
+            uniform_int_distribution<int> dist(-1000000000, 1000000000);
+            for (int &value: values) {
+                value = dist(rng);
+            }
+        } else if (distribution == "dense") {
+            // Small positive values: many primes, permuted.
+            for (size_t i = 0; i < size; ++i) {
+                values[i] = static_cast<int>(i);
+            }
+            shuffle(values.begin(), values.end(), rng);
+        } else if (distribution == "ascending") {
+            // Computed in long long and clamped, so sizes past INT_MAX / 3 stay defined.
+            for (size_t i = 0; i < size; ++i) {
+                values[i] = static_cast<int>(min<long long>(static_cast<long long>(i) * 3, INT_MAX));
+            }
+        } else {
+            for (size_t i = 0; i < size; ++i) {
+                values[i] = static_cast<int>(min<long long>(static_cast<long long>(size - i) * 3, INT_MAX));
+            }
+        }
+        return values;
+    }
+
+    void benchContainer(const string &distribution, size_t size) {
+        vector<int> values = makeValues(distribution, size, 42);
+        vector<int> removals = values;
+        shuffle(removals.begin(), removals.end(), mt19937(7));
+
+        MagicalContainer container;
+        auto start = Clock::now();
+        for (int value: values) {
+            container.addElement(value);
+        }
+        record("addElement", "MagicalContainer", distribution, size, size, Clock::now() - start);
+
+        start = Clock::now();
+        long long total = 0;
+        for (size_t i = 0; i < size; ++i) {
+            total += static_cast<long long>(container.size());
+        }
+        sink = sink + total;
+        record("size", "MagicalContainer", distribution, size, size, Clock::now() - start);
+
+        start = Clock::now();
+        total = 0;
+        MagicalContainer::AscendingIterator ascending(container);
+        for (auto it = ascending.begin(); it != ascending.end(); ++it) {
+            total += *it;
+        }
+        sink = sink + total;
+        record("AscendingIterator", "MagicalContainer", distribution, size, container.size(), Clock::now() - start);
+
+        start = Clock::now();
+        total = 0;
+        MagicalContainer::DescendingIterator descending(container);
+        for (auto it = descending.begin(); it != descending.end(); ++it) {
+            total += *it;
+        }
+        sink = sink + total;
+        record("DescendingIterator", "MagicalContainer", distribution, size, container.size(), Clock::now() - start);
+
+        start = Clock::now();
+        total = 0;
+        MagicalContainer::SideCrossIterator cross(container);
+        for (auto it = cross.begin(); it != cross.end(); ++it) {
+            total += *it;
+        }
+        sink = sink + total;
+        record("SideCrossIterator", "MagicalContainer", distribution, size, container.size(), Clock::now() - start);
+
+        start = Clock::now();
+        total = 0;
+        MagicalContainer::PrimeIterator prime(container);
+        for (auto it = prime.begin(); it != prime.end(); ++it) {
+            total += *it;
+        }
+        sink = sink + total;
+        record("PrimeIterator", "MagicalContainer", distribution, size, container.getPrimes().size(),
+               Clock::now() - start);
+
+        start = Clock::now();
+        for (int value: removals) {
+            try {
+                container.removeElement(value);
+            } catch (const runtime_error &) {
+                // duplicates in the input were only stored once
+            }
+        }
+        record("removeElement", "MagicalContainer", distribution, size, size, Clock::now() - start);
+    }
+
+    void benchSet(const string &distribution, size_t size) {
+        vector<int> values = makeValues(distribution, size, 42);
+        vector<int> removals = values;
+        shuffle(removals.begin(), removals.end(), mt19937(7));
+
+        set<int> container;
+        auto start = Clock::now();
+        for (int value: values) {
+            container.insert(value);
+        }
+        record("addElement", "std::set", distribution, size, size, Clock::now() - start);
+
+        start = Clock::now();
+        long long total = 0;
+        for (int value: container) {
+            total += value;
+        }
+        sink = sink + total;
+        record("AscendingIterator", "std::set", distribution, size, container.size(), Clock::now() - start);
+
+        start = Clock::now();
+        for (int value: removals) {
+            container.erase(value);
+        }
+        record("removeElement", "std::set", distribution, size, size, Clock::now() - start);
+    }
+
+    void benchVector(const string &distribution, size_t size) {
+        vector<int> values = makeValues(distribution, size, 42);
+
+        // Best case for bulk data: append everything, then sort and deduplicate once.
+        auto start = Clock::now();
+        vector<int> container(values);
+        sort(container.begin(), container.end());
+        container.erase(unique(container.begin(), container.end()), container.end());
+        record("addElement", "std::vector", distribution, size, size, Clock::now() - start);
+
+        start = Clock::now();
+        long long total = 0;
+        for (int value: container) {
+            total += value;
+        }
+        sink = sink + total;
+        record("AscendingIterator", "std::vector", distribution, size, container.size(), Clock::now() - start);
+    }
+
+    // Percentile dashboard lookups on one large container, against walking an AscendingIterator.
+    void benchPercentiles(size_t size) {
+        MagicalContainer container;
+        // Ascending even values append at the back and are rejected by isPrime at once.
+        for (size_t i = 0; i < size; ++i) {
+            container.addElement(static_cast<int>(i * 2));
+        }
+        const vector<double> percentiles = {0.5, 0.9, 0.99, 0.999};
+        mt19937 rng(11);
+        uniform_int_distribution<int> valueDist(0, static_cast<int>(size * 2));
+        const size_t lookups = 1000000;
+
+        auto start = Clock::now();
+        long long total = 0;
+        for (size_t i = 0; i < lookups; ++i) {
+            double percentile = percentiles[i % percentiles.size()];
+            total += container.kth(static_cast<size_t>(percentile * static_cast<double>(size - 1)));
+        }
+        sink = sink + total;
+        record("kth", "MagicalContainer", "even", size, lookups, Clock::now() - start);
+
+        start = Clock::now();
+        total = 0;
+        for (size_t i = 0; i < lookups; ++i) {
+            total += static_cast<long long>(container.rank(valueDist(rng)));
+        }
+        sink = sink + total;
+        record("rank", "MagicalContainer", "even", size, lookups, Clock::now() - start);
+
+        start = Clock::now();
+        total = 0;
+        for (double percentile: percentiles) {
+            auto target = static_cast<size_t>(percentile * static_cast<double>(size - 1));
+            MagicalContainer::AscendingIterator it(container);
+            for (size_t step = 0; step < target; ++step) {
+                ++it;
+            }
+            total += *it;
+        }
+        sink = sink + total;
+        record("kth", "AscendingIterator", "even", size, percentiles.size(), Clock::now() - start);
+    }
+
+    MagicalContainer strided(size_t size, int stride) {
+        MagicalContainer container;
+        for (size_t i = 0; i < size; ++i) {
+            container.addElement(static_cast<int>(i) * stride);
+        }
+        return container;
+    }
+
+    // Intersections of two large containers (similar sizes and 1000:1 skew) against std::set_intersection.
+    void benchSetAlgebra(size_t size) {
+        MagicalContainer evens = strided(size, 2);
+        MagicalContainer triples = strided(size, 3);
+        MagicalContainer sparse = strided(size / 1000, 2999);
+
+        auto start = Clock::now();
+        MagicalContainer both = MagicalContainer::intersectionOf(evens, triples);
+        record("intersectWith", "MagicalContainer", "strided", size, 1, Clock::now() - start);
+        sink = sink + static_cast<long long>(both.size());
+
+        start = Clock::now();
+        vector<int> expected;
+        expected.reserve(size);
+        set_intersection(evens.getElements().begin(), evens.getElements().end(), triples.getElements().begin(),
+                         triples.getElements().end(), back_inserter(expected));
+        record("intersectWith", "std::set_intersection", "strided", size, 1, Clock::now() - start);
+        sink = sink + static_cast<long long>(expected.size());
+
+        start = Clock::now();
+        MagicalContainer skewed = MagicalContainer::intersectionOf(sparse, triples);
+        record("intersectWith", "MagicalContainer", "skewed", size, 1, Clock::now() - start);
+        sink = sink + static_cast<long long>(skewed.size());
+
+        start = Clock::now();
+        MagicalContainer either = MagicalContainer::unionOf(evens, triples);
+        record("unionWith", "MagicalContainer", "strided", size, 1, Clock::now() - start);
+        sink = sink + static_cast<long long>(either.size());
+
+        start = Clock::now();
+        MagicalContainer onlyEvens = MagicalContainer::differenceOf(evens, triples);
+        record("differenceFrom", "MagicalContainer", "strided", size, 1, Clock::now() - start);
+        sink = sink + static_cast<long long>(onlyEvens.size());
+    }
+
+    // addElements of N random values into an empty container with 1, 2, 4, ... threads,
+    // against a single-threaded sort + unique of the same input.
+    void benchBulkLoad(size_t size) {
+        mt19937 rng(13);
+        uniform_int_distribution<int> valueDist(0, static_cast<int>(min<size_t>(size * 4, INT32_MAX)));
+        vector<int> values(size);
+        for (int &value: values) {
+            value = valueDist(rng);
+        }
+        size_t hardware = max(1U, thread::hardware_concurrency());
+        for (size_t threads = 1; threads <= hardware; threads *= 2) {
+            MagicalContainer container;
+            auto start = Clock::now();
+            container.addElements(values, threads);
+            record("addElements", "MagicalContainer", "uniform-" + to_string(threads) + "t", size, size,
+                   Clock::now() - start);
+            sink = sink + static_cast<long long>(container.size());
+        }
+
+        auto start = Clock::now();
+        vector<int> sorted = values;
+        sort(sorted.begin(), sorted.end());
+        sorted.erase(unique(sorted.begin(), sorted.end()), sorted.end());
+        record("addElements", "std::sort", "uniform-1t", size, size, Clock::now() - start);
+        sink = sink + static_cast<long long>(sorted.size());
+    }
+
+    // Whole-set sum and predicate count on one large container, against walking an AscendingIterator.
+    void benchReductions(size_t size) {
+        vector<int> values = makeValues("uniform", size, 7);
+        MagicalContainer container;
+        container.addElements(values);
+        string target = reductionTarget();
+
+        auto start = Clock::now();
+        sink = sink + container.sum();
+        record("sum", "MagicalContainer", "uniform-" + target, size, container.size(), Clock::now() - start);
+
+        start = Clock::now();
+        sink = sink + static_cast<long long>(container.countMasked(1, 0));
+        record("countMasked", "MagicalContainer", "uniform-" + target, size, container.size(), Clock::now() - start);
+
+        start = Clock::now();
+        long long total = 0;
+        MagicalContainer::AscendingIterator it(container);
+        for (auto current = it.begin(); current != it.end(); ++current) {
+            total += *current;
+        }
+        sink = sink + total;
+        record("sum", "AscendingIterator", "uniform", size, container.size(), Clock::now() - start);
+    }
+
+    // save()/load() of one container of N uniform values, against rebuilding it by replaying
+    // addElement in ascending order. The saved size is reported on stderr.
+    void benchSerialization(size_t size) {
+        MagicalContainer container;
+        container.addElements(makeValues("uniform", size, 9));
+        FILE *file = tmpfile();
+        if (file == nullptr) {
+            return;
+        }
+        int fd = fileno(file);
+
+        auto start = Clock::now();
+        container.save(fd);
+        record("save", "MagicalContainer", "uniform", size, container.size(), Clock::now() - start);
+        auto bytes = static_cast<double>(lseek(fd, 0, SEEK_END));
+
+        lseek(fd, 0, SEEK_SET);
+        start = Clock::now();
+        MagicalContainer loaded = MagicalContainer::load(fd);
+        record("load", "MagicalContainer", "uniform", size, container.size(), Clock::now() - start);
+        sink = sink + static_cast<long long>(loaded.size());
+        fclose(file);
+
+        start = Clock::now();
+        MagicalContainer replayed;
+        for (int value: container.getElements()) {
+            replayed.addElement(value);
+        }
+        record("load", "addElement replay", "uniform", size, container.size(), Clock::now() - start);
+        sink = sink + static_cast<long long>(replayed.size());
+
+        cerr << "saved " << container.size() << " values in " << bytes << " bytes ("
+             << bytes / static_cast<double>(container.size()) << " bytes/value, " << codecTarget() << ")" << endl;
+    }
+
+    // N ascending addElement calls offered at one million per second, with and without the
+    // write-ahead log; only the time spent inside the calls is recorded. Calls are paced in
+    // bursts of 1000 so the log's flusher thread is not starved on small machines. The
+    // number of fsyncs and the final sync() latency are reported on stderr. Reopening the
+    // directory is then timed from the full log and from a checkpoint.
+    void benchWriteAheadLog(size_t size) {
+        constexpr size_t BURST = 1000;
+        auto paced = [size](auto &&add) {
+            Clock::duration inside{};
+            auto begin = Clock::now();
+            for (size_t first = 0; first < size; first += BURST) {
+                this_thread::sleep_until(begin + chrono::microseconds(first));
+                auto start = Clock::now();
+                for (size_t i = first; i < min(size, first + BURST); ++i) {
+                    add(static_cast<int>(i));
+                }
+                inside += Clock::now() - start;
+            }
+            return inside;
+        };
+
+        MagicalContainer plain;
+        record("addElement", "MagicalContainer", "paced-1M", size, size,
+               paced([&plain](int value) { plain.addElement(value); }));
+        sink = sink + static_cast<long long>(plain.size());
+
+        char pattern[] = "/tmp/magical-bench-XXXXXX";
+        if (mkdtemp(pattern) == nullptr) {
+            return;
+        }
+        {
+            DurableMagicalContainer durable(pattern);
+            record("addElement", "DurableMagicalContainer", "paced-1M", size, size,
+                   paced([&durable](int value) { durable.addElement(value); }));
+            auto start = Clock::now();
+            durable.sync();
+            double syncMicros = chrono::duration<double, micro>(Clock::now() - start).count();
+            uint64_t syncs = durable.getLog().syncCount();
+            cerr << "logged " << size << " adds in " << syncs << " fsyncs ("
+                 << static_cast<double>(size) / static_cast<double>(max<uint64_t>(1, syncs))
+                 << " records/fsync), final sync " << syncMicros << " us" << endl;
+            sink = sink + static_cast<long long>(durable.size());
+        }
+
+        // Reopening: first by replaying the whole log, then from a checkpoint with an empty tail.
+        for (const char *source: {"wal-replay", "checkpoint"}) {
+            auto start = Clock::now();
+            DurableMagicalContainer reopened(pattern);
+            record("recover", "DurableMagicalContainer", source, size, size, Clock::now() - start);
+            sink = sink + static_cast<long long>(reopened.size());
+            reopened.checkpoint();
+            reopened.waitForCheckpoint();
+        }
+        filesystem::remove_all(pattern);
+    }
+
+    // AscendingIterator over one container with latency sampling off, at one step in 1000, and
+    // at every step, so the cost of the LatencyScope in operator++ shows up as the difference.
+    // The previous sampling period is restored afterwards.
+    void benchLatencyOverhead(size_t size) {
+        MagicalContainer container;
+        container.addElements(makeValues("uniform", size, 42));
+        uint32_t previous = LatencyRecorder::getSampling();
+        const size_t passes = 20;
+        for (uint32_t period: {0U, 1000U, 1U}) {
+            LatencyRecorder::setSampling(period);
+            auto start = Clock::now();
+            long long total = 0;
+            for (size_t pass = 0; pass < passes; ++pass) {
+                MagicalContainer::AscendingIterator ascending(container);
+                for (auto it = ascending.begin(); it != ascending.end(); ++it) {
+                    total += *it;
+                }
+            }
+            sink = sink + total;
+            record("AscendingIterator", "MagicalContainer", period == 0 ? "sampling-off" : "sampling-" + to_string(period),
+                   size, passes * container.size(), Clock::now() - start);
+        }
+        LatencyRecorder::setSampling(previous);
+    }
+
+    // Sorting one ingest batch: radixSort against std::sort on the same input.
+    void benchBatchSort(const string &distribution, size_t size) {
+        vector<int> batch = makeValues(distribution, size, 42);
+        vector<int> copy = batch;
+        auto start = Clock::now();
+        radixSort(copy);
+        record("batchSort", "radixSort", distribution, size, size, Clock::now() - start);
+        sink = sink + (copy.empty() ? 0 : copy[size / 2]);
+
+        copy = batch;
+        start = Clock::now();
+        sort(copy.begin(), copy.end());
+        record("batchSort", "std::sort", distribution, size, size, Clock::now() - start);
+        sink = sink + (copy.empty() ? 0 : copy[size / 2]);
+    }
+
+    void printJson(ostream &out) {
+        out << "{\n  \"benchmarks\": [\n";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const Result &res = results[i];
+            out << "    {\"name\": \"" << res.name << "\", \"impl\": \"" << res.impl
+                << "\", \"distribution\": \"" << res.distribution << "\", \"size\": " << res.size
+                << ", \"ops\": " << res.ops << ", \"ns_per_op\": " << res.median
+                << ", \"ci_low\": " << res.ciLow << ", \"ci_high\": " << res.ciHigh
+                << ", \"repetitions\": " << res.samples.size() << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        out << "  ]";
+        if (LatencyRecorder::getSampling() != 0) {
+            out << ",\n  \"latency_sampling\": " << LatencyRecorder::getSampling()
+                << ",\n  \"latency\": {\"addElement\": " << LatencyRecorder::snapshot(LatencyOp::ADD).toJson()
+                << ", \"removeElement\": " << LatencyRecorder::snapshot(LatencyOp::REMOVE).toJson()
+                << ", \"iterator++\": " << LatencyRecorder::snapshot(LatencyOp::ITERATE).toJson() << "}";
+        }
+        out << "\n}\n";
+    }
+
+    // Reads a field from one benchmark record line of a file written by printJson().
+    string jsonField(const string &line, const string &key) {
+        string pattern = "\"" + key + "\": ";
+        size_t pos = line.find(pattern);
+        if (pos == string::npos) {
+            return "";
+        }
+        pos += pattern.size();
+        if (line[pos] == '"') {
+            return line.substr(pos + 1, line.find('"', pos + 1) - pos - 1);
+        }
+        return line.substr(pos, line.find_first_of(",}", pos) - pos);
+    }
+
+    // Compares MagicalContainer results against a baseline. A benchmark regresses when its median
+    // is more than `threshold` slower and the confidence intervals do not overlap.
+    int compareWithBaseline(const string &path, double threshold) {
+        ifstream in(path);
+        if (!in) {
+            cerr << "Cannot open baseline " << path << endl;
+            return 2;
+        }
+        int regressions = 0;
+        string line;
+        while (getline(in, line)) {
+            if (jsonField(line, "impl") != "MagicalContainer") {
+                continue;
+            }
+            string key = keyOf(jsonField(line, "name"), "MagicalContainer", jsonField(line, "distribution"),
+                               stoul(jsonField(line, "size")));
+            auto found = resultIndex.find(key);
+            if (found == resultIndex.end()) {
+                continue;
+            }
+            const Result &res = results[found->second];
+            double baseMedian = stod(jsonField(line, "ns_per_op"));
+            double baseHigh = stod(jsonField(line, "ci_high"));
+            double change = baseMedian == 0 ? 0 : res.median / baseMedian - 1;
+            bool regressed = change > threshold && res.ciLow > baseHigh;
+            if (regressed) {
+                ++regressions;
+            }
+            cerr << (regressed ? "REGRESSION " : "ok         ") << res.name << " " << res.distribution << " n="
+                 << res.size << ": " << baseMedian << " -> " << res.median << " ns/op (" << (change >= 0 ? "+" : "")
+                 << change * 100 << "%)" << endl;
+        }
+        cerr << regressions << " regression(s) over " << threshold * 100 << "%" << endl;
+        return regressions == 0 ? 0 : 1;
+    }
+
+    vector<size_t> parseSizes(const string &list) {
+        vector<size_t> sizes;
+        stringstream stream(list);
+        string item;
+        while (getline(stream, item, ',')) {
+            sizes.push_back(stoul(item));
+        }
+        return sizes;
+    }
+}
+
+// Usage: ./bench [--sizes 1000,10000,100000] [--repetitions R] [--latency-sampling N]
+//                [--percentiles N] [--set-algebra N] [--bulk-load N] [--batch-sort] [--reductions N] [--serialize N] [--wal N] [--latency-overhead N] [--save-baseline FILE] [--compare FILE [--threshold PERCENT]]
+// Prints one JSON record per (operation, implementation, distribution, size) with the median
+// ns/op over R runs and its confidence interval.
+// With --percentiles, kth/rank lookups are also timed on one container of N elements (e.g. 50000000).
+// With --set-algebra, intersection/union/difference of two N-element containers are timed.
+// With --batch-sort, radixSort and std::sort are also timed on one batch of each size and distribution.
+// With --reductions, sum and countMasked over one container of N uniform values are timed.
+// With --serialize, save/load of one N-value container is timed against replaying addElement.
+// With --wal, N addElement calls paced at 1M/s are timed with and without the write-ahead log,
+// and so is recovery from the log alone and from a checkpoint.
+// With --latency-overhead, an AscendingIterator over N values is timed with latency sampling off and on.
+// With --bulk-load, addElements of N values is timed at every power-of-two thread count up to the core count.
+// With --latency-sampling, one container operation in N is also timed into the latency histograms.
+// With --compare, exits with 1 when a MagicalContainer operation regressed past the threshold (default 10%).
+int main(int argc, char **argv) {
+    vector<size_t> sizes = {1000, 10000, 100000};
+    size_t repetitions = 1;
+    string baselineOut;
+    string baselineIn;
+    double threshold = 0.10;
+    size_t percentileSize = 0;
+    size_t setAlgebraSize = 0;
+    size_t bulkLoadSize = 0;
+    bool batchSort = false;
+    size_t reductionSize = 0;
+    size_t serializeSize = 0;
+    size_t walSize = 0;
+    size_t latencyOverheadSize = 0;
+    vector<string> args(argv + 1, argv + argc);
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i] == "--sizes" && i + 1 < args.size()) {
+            sizes = parseSizes(args[++i]);
+        } else if (args[i] == "--repetitions" && i + 1 < args.size()) {
+            repetitions = max<size_t>(1, stoul(args[++i]));
+        } else if (args[i] == "--latency-sampling" && i + 1 < args.size()) {
+            LatencyRecorder::setSampling(static_cast<uint32_t>(stoul(args[++i])));
+        } else if (args[i] == "--percentiles" && i + 1 < args.size()) {
+            percentileSize = stoul(args[++i]);
+        } else if (args[i] == "--set-algebra" && i + 1 < args.size()) {
+            setAlgebraSize = stoul(args[++i]);
+        } else if (args[i] == "--reductions" && i + 1 < args.size()) {
+            reductionSize = stoul(args[++i]);
+        } else if (args[i] == "--serialize" && i + 1 < args.size()) {
+            serializeSize = stoul(args[++i]);
+        } else if (args[i] == "--wal" && i + 1 < args.size()) {
+            walSize = stoul(args[++i]);
+        } else if (args[i] == "--latency-overhead" && i + 1 < args.size()) {
+            latencyOverheadSize = stoul(args[++i]);
+        } else if (args[i] == "--batch-sort") {
+            batchSort = true;
+        } else if (args[i] == "--bulk-load" && i + 1 < args.size()) {
+            bulkLoadSize = stoul(args[++i]);
+        } else if (args[i] == "--save-baseline" && i + 1 < args.size()) {
+            baselineOut = args[++i];
+        } else if (args[i] == "--compare" && i + 1 < args.size()) {
+            baselineIn = args[++i];
+        } else if (args[i] == "--threshold" && i + 1 < args.size()) {
+            threshold = stod(args[++i]) / 100;
+        } else {
+            cerr << "Usage: " << argv[0] << " [--sizes N,N,...] [--repetitions R] [--latency-sampling N]"
+                 << " [--percentiles N] [--set-algebra N] [--bulk-load N] [--batch-sort] [--reductions N] [--serialize N] [--wal N] [--latency-overhead N] [--save-baseline FILE] [--compare FILE [--threshold PERCENT]]" << endl;
+            return 2;
+        }
+    }
+
+    const vector<string> distributions = {"uniform", "dense", "ascending", "descending"};
+    for (size_t rep = 0; rep < repetitions; ++rep) {
+        for (size_t size: sizes) {
+            for (const string &distribution: distributions) {
+                benchContainer(distribution, size);
+                benchSet(distribution, size);
+                benchVector(distribution, size);
+                if (batchSort) {
+                    benchBatchSort(distribution, size);
+                }
+            }
+        }
+        if (percentileSize > 1) {
+            benchPercentiles(percentileSize);
+        }
+        if (setAlgebraSize > 0) {
+            benchSetAlgebra(setAlgebraSize);
+        }
+        if (bulkLoadSize > 0) {
+            benchBulkLoad(bulkLoadSize);
+        }
+        if (reductionSize > 0) {
+            benchReductions(reductionSize);
+        }
+        if (serializeSize > 0) {
+            benchSerialization(serializeSize);
+        }
+        if (walSize > 0) {
+            benchWriteAheadLog(walSize);
+        }
+        if (latencyOverheadSize > 0) {
+            benchLatencyOverhead(latencyOverheadSize);
+        }
+    }
+    for (Result &res: results) {
+        summarize(res);
+    }
+    printJson(cout);
+    if (!baselineOut.empty()) {
+        ofstream out(baselineOut);
+        printJson(out);
+    }
+    if (!baselineIn.empty()) {
+        return compareWithBaseline(baselineIn, threshold);
+    }
+    return 0;
+}
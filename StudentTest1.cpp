@@ -1,6 +1,27 @@
 #include "doctest.h"
 #include "sources/MagicalContainer.hpp"
+#include "sources/BulkLoad.hpp"
+#include "sources/Codec.hpp"
+#include "sources/DurableMagicalContainer.hpp"
+#include "sources/MagicalContainerC.h"
+#include "sources/MagicalPredicates.hpp"
+#include "sources/ShardedMagicalContainer.hpp"
+#include "sources/SharedMagicalContainer.hpp"
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <numeric>
+#include <random>
+#include <set>
 #include <stdexcept>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 using namespace ariel;
 using namespace std;
@@ -108,6 +129,8 @@ TEST_CASE("SideCrossIterator")
         MagicalContainer emptyContainer;
         MagicalContainer::SideCrossIterator it(emptyContainer);
         CHECK(it == it.end());
+        bool beginIsEnd = it.begin() == it.end();
+        CHECK(beginIsEnd);
     }
 }
 
@@ -642,3 +665,1437 @@ TEST_CASE("operator= throws when iterators are pointing at different containers"
         CHECK_THROWS_AS(it1 = it2, std::runtime_error);
     }
 }
+
+TEST_CASE("Snapshot shares storage until the container is mutated")
+{
+    MagicalContainer container;
+    container.addElement(4);
+    container.addElement(7);
+    container.addElement(9);
+
+    MagicalContainer snap = container.snapshot();
+    CHECK(&snap.getElements() == &container.getElements());
+    CHECK(&snap.getPrimes() == &container.getPrimes());
+
+    SUBCASE("Mutating the container leaves the snapshot unchanged")
+    {
+        container.addElement(10);
+        container.removeElement(7);
+        CHECK(container.size() == 3);
+        CHECK(snap.size() == 3);
+        CHECK(snap.getElements() == vector<int>{4, 7, 9});
+        CHECK(snap.getPrimes() == vector<int>{7});
+        CHECK(container.getPrimes().empty());
+    }
+
+    SUBCASE("A non-prime insert only copies the element vector")
+    {
+        container.addElement(8);
+        CHECK(&snap.getElements() != &container.getElements());
+        CHECK(&snap.getPrimes() == &container.getPrimes());
+    }
+
+    SUBCASE("Iterators run on the snapshot")
+    {
+        container.addElement(1);
+        MagicalContainer::AscendingIterator it(snap);
+        CHECK(*it == 4);
+        ++(++(++it));
+        CHECK(it == it.end());
+    }
+
+    SUBCASE("Moving hands the storage over without sharing it")
+    {
+        MagicalContainer source = container;
+        source.addElement(12);
+        const vector<int> *elements = &source.getElements();
+        MagicalContainer moved(std::move(source));
+        moved.removeElement(12);
+        CHECK(&moved.getElements() == elements);
+        MagicalContainer assigned;
+        assigned = std::move(moved);
+        assigned.addElement(14);
+        CHECK(&assigned.getElements() == elements);
+    }
+}
+
+TEST_CASE("Container statistics")
+{
+    MagicalContainer container;
+    container.addElement(1);
+    container.addElement(7);
+    container.addElement(3);
+    container.removeElement(7);
+
+    MagicalStats stats = container.stats();
+    CHECK(stats.bytesUsed == 3 * sizeof(int));
+    CHECK(stats.bytesReserved >= stats.bytesUsed);
+    CHECK(container.stats().toJson().find("\"bytesUsed\": 12") != string::npos);
+
+    MagicalContainer::AscendingIterator it(container);
+    CHECK_THROWS_AS(++(++(++it)), runtime_error);
+
+    if (container.stats().enabled) {
+        stats = container.stats();
+        CHECK(stats.primeChecks == 4);
+        CHECK(stats.elementsShifted == 2);
+        CHECK(stats.iteratorExceptions == 1);
+    }
+}
+
+TEST_CASE("Latency histograms")
+{
+    SUBCASE("Percentiles stay within the bucket resolution")
+    {
+        LatencyHistogram histogram;
+        for (uint64_t value = 1; value <= 1000; ++value) {
+            histogram.record(value);
+        }
+        CHECK(histogram.count() == 1000);
+        CHECK(histogram.min() == 1);
+        CHECK(histogram.max() == 1000);
+        CHECK(histogram.percentile(50) >= 500);
+        CHECK(histogram.percentile(50) <= 516);
+        CHECK(histogram.percentile(100) == 1000);
+
+        LatencyHistogram other;
+        other.record(5000);
+        histogram.merge(other);
+        CHECK(histogram.count() == 1001);
+        CHECK(histogram.max() == 5000);
+    }
+
+    SUBCASE("Container operations are recorded when sampled")
+    {
+        LatencyRecorder::reset();
+        LatencyRecorder::setSampling(1);
+        MagicalContainer container;
+        container.addElement(3);
+        container.addElement(4);
+        container.removeElement(3);
+        MagicalContainer::AscendingIterator it(container);
+        ++it;
+        LatencyRecorder::setSampling(0);
+        container.addElement(5);
+
+        CHECK(LatencyRecorder::snapshot(LatencyOp::ADD).count() == 2);
+        CHECK(LatencyRecorder::snapshot(LatencyOp::REMOVE).count() == 1);
+        CHECK(LatencyRecorder::snapshot(LatencyOp::ITERATE).count() == 1);
+        LatencyRecorder::reset();
+        CHECK(LatencyRecorder::snapshot(LatencyOp::ADD).count() == 0);
+
+        LatencyRecorder::setSampling(4);
+        for (int value = 10; value < 22; ++value) {
+            container.addElement(value);
+        }
+        LatencyRecorder::setSampling(0);
+        CHECK(LatencyRecorder::snapshot(LatencyOp::ADD).count() == 3);
+        LatencyRecorder::reset();
+    }
+
+    SUBCASE("Exited threads keep their samples but leave the registry")
+    {
+        LatencyRecorder::reset();
+        LatencyRecorder::record(LatencyOp::ADD, 1);
+        size_t live = LatencyRecorder::recordingThreads();
+        for (int worker = 0; worker < 20; ++worker) {
+            thread([] { LatencyRecorder::record(LatencyOp::ADD, 10); }).join();
+        }
+        CHECK(LatencyRecorder::recordingThreads() == live);
+        LatencyHistogram total = LatencyRecorder::snapshot(LatencyOp::ADD);
+        CHECK(total.count() == 21);
+        CHECK(total.max() == 10);
+        LatencyRecorder::reset();
+        CHECK(LatencyRecorder::snapshot(LatencyOp::ADD).count() == 0);
+    }
+}
+
+TEST_CASE("Reverse iterators")
+{
+    MagicalContainer container;
+    container.addElement(1);
+    container.addElement(2);
+    container.addElement(4);
+    container.addElement(5);
+    container.addElement(14);
+
+    SUBCASE("DescendingIterator")
+    {
+        vector<int> seen;
+        MagicalContainer::DescendingIterator it(container);
+        for (auto pos = it.begin(); pos != it.end(); ++pos) {
+            seen.push_back(*pos);
+        }
+        CHECK(seen == vector<int>{14, 5, 4, 2, 1});
+        auto last = it.end();
+        CHECK(last > it);
+        CHECK_THROWS_AS(++last, runtime_error);
+    }
+
+    SUBCASE("ReverseSideCrossIterator goes from the center outwards")
+    {
+        vector<int> seen;
+        MagicalContainer::ReverseSideCrossIterator it(container);
+        for (auto pos = it.begin(); pos != it.end(); ++pos) {
+            seen.push_back(*pos);
+        }
+        CHECK(seen == vector<int>{4, 5, 2, 14, 1});
+
+        container.addElement(20);
+        seen.clear();
+        for (auto pos = it.begin(); pos != it.end(); ++pos) {
+            seen.push_back(*pos);
+        }
+        CHECK(seen == vector<int>{5, 4, 14, 2, 20, 1});
+    }
+
+    SUBCASE("ReversePrimeIterator")
+    {
+        MagicalContainer::ReversePrimeIterator it(container);
+        CHECK(*it == 5);
+        ++it;
+        CHECK(*it == 2);
+        ++it;
+        CHECK(it == it.end());
+    }
+
+    SUBCASE("Comparisons follow the same-container rules")
+    {
+        MagicalContainer other;
+        MagicalContainer::DescendingIterator it1(container);
+        MagicalContainer::DescendingIterator it2(other);
+        MagicalContainer::AscendingIterator ascending(container);
+        CHECK_THROWS_AS((void)(it1 == it2), runtime_error);
+        CHECK_THROWS_AS(it1 = it2, runtime_error);
+        const MagicalContainer::Iterator &base = ascending;
+        CHECK_THROWS_AS((void)(it1 == base), runtime_error);
+    }
+}
+
+TEST_CASE("FilteredIterator")
+{
+    MagicalContainer container;
+    for (int value: {1, 2, 4, 5, 9, 14, 16}) {
+        container.addElement(value);
+    }
+
+    SUBCASE("Walks only matching elements")
+    {
+        vector<int> even;
+        MagicalContainer::FilteredIterator<IsEven> it(container);
+        for (auto pos = it.begin(); pos != it.end(); ++pos) {
+            even.push_back(*pos);
+        }
+        CHECK(even == vector<int>{2, 4, 14, 16});
+
+        MagicalContainer::FilteredIterator<IsPerfectSquare> squares(container);
+        CHECK(container.getFiltered<IsPerfectSquare>() == vector<int>{1, 4, 9, 16});
+        CHECK(*squares == 1);
+    }
+
+    SUBCASE("The index follows later mutations")
+    {
+        MagicalContainer::FilteredIterator<InBitmask<0b100100>> tenants(container);
+        CHECK(*tenants == 2);
+        CHECK(tenants.end().getIndex() == 2);
+        container.addElement(5);
+        container.addElement(0);
+        container.removeElement(2);
+        container.addElement(65);
+        CHECK(container.getFiltered<InBitmask<0b100100>>() == vector<int>{5});
+    }
+
+    SUBCASE("Different predicates do not compare")
+    {
+        MagicalContainer::FilteredIterator<IsEven> even(container);
+        MagicalContainer::FilteredIterator<IsPerfectSquare> squares(container);
+        const MagicalContainer::Iterator &base = squares;
+        CHECK_THROWS_AS((void)(even == base), runtime_error);
+        MagicalContainer fresh;
+        CHECK_THROWS_AS((void)fresh.getFiltered<IsEven>(), runtime_error);
+    }
+}
+
+TEST_CASE("ComposedIterator combines any order with any subset")
+{
+    MagicalContainer container;
+    for (int value: {1, 2, 3, 4, 5, 7, 8, 11, 14}) {
+        container.addElement(value);
+    }
+    auto walk = [&container](MagicalContainer::Order order, MagicalContainer::Subset subset) {
+        vector<int> seen;
+        MagicalContainer::ComposedIterator it(container, order, subset);
+        for (auto pos = it.begin(); pos != it.end(); ++pos) {
+            seen.push_back(*pos);
+        }
+        return seen;
+    };
+    using Order = MagicalContainer::Order;
+    using Subset = MagicalContainer::Subset;
+
+    CHECK(walk(Order::SIDE_CROSS, Subset::PRIMES) == vector<int>{2, 11, 3, 7, 5});
+    CHECK(walk(Order::ASCENDING, Subset::NON_PRIMES) == vector<int>{1, 4, 8, 14});
+    CHECK(walk(Order::DESCENDING, Subset::NON_PRIMES) == vector<int>{14, 8, 4, 1});
+    CHECK(walk(Order::SIDE_CROSS, Subset::ALL) == vector<int>{1, 14, 2, 11, 3, 8, 4, 7, 5});
+    CHECK(walk(Order::DESCENDING, Subset::PRIMES) == vector<int>{11, 7, 5, 3, 2});
+
+    container.addElement(9);
+    container.removeElement(4);
+    CHECK(walk(Order::ASCENDING, Subset::NON_PRIMES) == vector<int>{1, 8, 9, 14});
+
+    // Non-primes are selected by rank over the prime index, whatever runs of primes surround them.
+    MagicalContainer mixed;
+    mt19937 rng(5);
+    uniform_int_distribution<int> valueDist(-50, 400);
+    for (int i = 0; i < 300; ++i) {
+        mixed.addElement(valueDist(rng));
+    }
+    vector<int> nonPrimes;
+    set_difference(mixed.getElements().begin(), mixed.getElements().end(), mixed.getPrimes().begin(),
+                   mixed.getPrimes().end(), back_inserter(nonPrimes));
+    vector<int> seen;
+    MagicalContainer::ComposedIterator sideCross(mixed, Order::SIDE_CROSS, Subset::NON_PRIMES);
+    for (auto pos = sideCross.begin(); pos != sideCross.end(); ++pos) {
+        seen.push_back(*pos);
+    }
+    REQUIRE(seen.size() == nonPrimes.size());
+    for (size_t step = 0; step < seen.size(); ++step) {
+        CHECK(seen[step] == nonPrimes[step % 2 == 0 ? step / 2 : nonPrimes.size() - 1 - step / 2]);
+    }
+
+    MagicalContainer::ComposedIterator primes(container, Order::ASCENDING, Subset::PRIMES);
+    MagicalContainer::ComposedIterator all(container, Order::ASCENDING, Subset::ALL);
+    CHECK_THROWS_AS((void)(primes == all), runtime_error);
+    auto last = primes.end();
+    CHECK(last > primes);
+    CHECK_THROWS_AS(++last, runtime_error);
+}
+
+TEST_CASE("Range views compose lazily")
+{
+    MagicalContainer container;
+    for (int value: {1, 2, 4, 5, 7, 14, 16, 19}) {
+        container.addElement(value);
+    }
+
+    vector<int> seen;
+    for (int value: container.ascending() | views::filter([](int v) { return v > 3; }) | views::take(3)) {
+        seen.push_back(value);
+    }
+    CHECK(seen == vector<int>{4, 5, 7});
+
+    seen.clear();
+    for (int value: container.primes() | views::transform([](int v) { return v * 10; })) {
+        seen.push_back(value);
+    }
+    CHECK(seen == vector<int>{20, 50, 70, 190});
+
+    seen.clear();
+    for (int value: container.descending() | views::take(2)) {
+        seen.push_back(value);
+    }
+    CHECK(seen == vector<int>{19, 16});
+
+    seen.clear();
+    for (int value: container.sideCross()) {
+        seen.push_back(value);
+    }
+    CHECK(seen == vector<int>{1, 19, 2, 16, 4, 14, 5, 7});
+
+    CHECK(ranges::distance(container.filtered<IsEven>()) == 4);
+}
+
+TEST_CASE("SampleIterator")
+{
+    MagicalContainer container;
+    for (int value = 1; value <= 100; ++value) {
+        container.addElement(value);
+    }
+    auto draw = [](MagicalContainer::SampleIterator it) {
+        vector<int> seen;
+        for (auto pos = it.begin(); pos != it.end(); ++pos) {
+            seen.push_back(*pos);
+        }
+        return seen;
+    };
+
+    SUBCASE("Without replacement every sample is distinct")
+    {
+        vector<int> seen = draw(MagicalContainer::SampleIterator(container, 30, 1234));
+        CHECK(seen.size() == 30);
+        sort(seen.begin(), seen.end());
+        CHECK(adjacent_find(seen.begin(), seen.end()) == seen.end());
+
+        vector<int> all = draw(MagicalContainer::SampleIterator(container, 500, 99));
+        sort(all.begin(), all.end());
+        CHECK(all == container.getElements());
+
+        // Enough draws for the displaced-position map to rehash many times.
+        MagicalContainer large;
+        vector<int> values(20000);
+        iota(values.begin(), values.end(), 0);
+        large.addElements(values);
+        vector<int> permuted = draw(MagicalContainer::SampleIterator(large, values.size(), 17));
+        sort(permuted.begin(), permuted.end());
+        CHECK(permuted == values);
+    }
+
+    SUBCASE("Seeds make runs reproducible")
+    {
+        CHECK(draw(MagicalContainer::SampleIterator(container, 10, 7, true)) ==
+              draw(MagicalContainer::SampleIterator(container, 10, 7, true)));
+        CHECK(draw(MagicalContainer::SampleIterator(container, 10, 7)) !=
+              draw(MagicalContainer::SampleIterator(container, 10, 8)));
+        CHECK(draw(MagicalContainer::SampleIterator(container, 200, 3, true)).size() == 200);
+    }
+
+    SUBCASE("Prime-only samples")
+    {
+        vector<int> seen = draw(MagicalContainer::SampleIterator(container, 25, 5, false,
+                                                                 MagicalContainer::Subset::PRIMES));
+        sort(seen.begin(), seen.end());
+        CHECK(seen == container.getPrimes());
+
+        MagicalContainer::SampleIterator it(container, 2, 5, false, MagicalContainer::Subset::PRIMES);
+        ++(++it);
+        CHECK(it == it.end());
+        CHECK_THROWS_AS(++it, runtime_error);
+    }
+
+    SUBCASE("Non-prime samples cover exactly the complement")
+    {
+        vector<int> nonPrimes;
+        set_difference(container.getElements().begin(), container.getElements().end(),
+                       container.getPrimes().begin(), container.getPrimes().end(), back_inserter(nonPrimes));
+        vector<int> seen = draw(MagicalContainer::SampleIterator(container, container.size(), 11, false,
+                                                                 MagicalContainer::Subset::NON_PRIMES));
+        sort(seen.begin(), seen.end());
+        CHECK(seen == nonPrimes);
+    }
+}
+
+TEST_CASE("Range queries")
+{
+    MagicalContainer container;
+    for (int value: {-5, 1, 2, 4, 5, 7, 9, 11, 14}) {
+        container.addElement(value);
+    }
+
+    auto range = container.ascendingRange(3, 10);
+    vector<int> seen;
+    for (auto it = range.first; it != range.second; ++it) {
+        seen.push_back(*it);
+    }
+    CHECK(seen == vector<int>{4, 5, 7, 9});
+
+    auto primes = container.primeRange(2, 11);
+    seen.clear();
+    for (auto it = primes.first; it != primes.second; ++it) {
+        seen.push_back(*it);
+    }
+    CHECK(seen == vector<int>{2, 5, 7});
+
+    CHECK(container.countRange(3, 10) == 4);
+    CHECK(container.countRange(-100, 100) == 9);
+    CHECK(container.countRange(10, 3) == 0);
+    CHECK(container.countPrimesInRange(0, 100) == 4);
+    CHECK(container.countPrimesInRange(12, 100) == 0);
+
+    auto empty = container.ascendingRange(100, 200);
+    CHECK(empty.first == empty.second);
+    CHECK(empty.first == empty.first.end());
+}
+
+TEST_CASE("Order statistics")
+{
+    MagicalContainer container;
+    for (int value: {9, -3, 2, 14, 5, 7, 4}) {
+        container.addElement(value);
+    }
+    CHECK(container.kth(0) == -3);
+    CHECK(container.kth(3) == 5);
+    CHECK(container.kth(6) == 14);
+    CHECK_THROWS_AS((void)container.kth(7), runtime_error);
+    CHECK(container.rank(-10) == 0);
+    CHECK(container.rank(5) == 3);
+    CHECK(container.rank(6) == 4);
+    CHECK(container.rank(100) == 7);
+
+    CHECK(container.primeKth(0) == 2);
+    CHECK(container.primeKth(2) == 7);
+    CHECK_THROWS_AS((void)container.primeKth(3), runtime_error);
+    CHECK(container.primeRank(7) == 2);
+    CHECK(container.primeRank(8) == 3);
+}
+
+TEST_CASE("Prefix-sum range queries")
+{
+    MagicalContainer container;
+    for (int value: {-4, 1, 2, 3, 8, 11, 20}) {
+        container.addElement(value);
+    }
+    CHECK(container.rangeSum(0, 10) == 14);
+    CHECK(container.primeRangeSum(0, 100) == 16);
+
+    container.enablePrefixSums();
+    CHECK(container.hasPrefixSums());
+    CHECK(container.rangeSum(0, 10) == 14);
+    CHECK(container.rangeSum(-100, 100) == 41);
+    CHECK(container.rangeSum(5, 5) == 0);
+    CHECK(container.rangeMean(1, 4) == doctest::Approx(2.0));
+    CHECK(container.primeRangeMean(3, 12) == doctest::Approx(7.0));
+
+    MagicalContainer snap = container.snapshot();
+    container.addElement(5);
+    container.addElement(-10);
+    container.removeElement(8);
+    container.removeElement(2);
+    CHECK(container.rangeSum(-100, 100) == 41 + 5 - 10 - 8 - 2);
+    CHECK(container.rangeSum(0, 10) == 9);
+    CHECK(container.primeRangeSum(0, 100) == 19);
+    CHECK(container.primeRangeMean(0, 100) == doctest::Approx(19.0 / 3));
+    CHECK(snap.rangeSum(-100, 100) == 41);
+
+    container.enablePrefixSums(false);
+    CHECK_FALSE(container.hasPrefixSums());
+    CHECK(container.rangeSum(0, 10) == 9);
+    CHECK(container.rangeMean(100, 200) == 0.0);
+}
+
+TEST_CASE("Set algebra between containers")
+{
+    MagicalContainer first;
+    MagicalContainer second;
+    for (int value: {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13}) {
+        first.addElement(value);
+    }
+    for (int value: {2, 4, 5, 11, 13, 17, 20}) {
+        second.addElement(value);
+    }
+
+    SUBCASE("New containers")
+    {
+        MagicalContainer both = MagicalContainer::intersectionOf(first, second);
+        CHECK(both.getElements() == vector<int>{2, 4, 5, 11, 13});
+        CHECK(both.getPrimes() == vector<int>{2, 5, 11, 13});
+
+        MagicalContainer either = MagicalContainer::unionOf(first, second);
+        CHECK(either.size() == 15);
+        CHECK(either.getPrimes() == vector<int>{2, 3, 5, 7, 11, 13, 17});
+
+        MagicalContainer onlyFirst = MagicalContainer::differenceOf(first, second);
+        CHECK(onlyFirst.getElements() == vector<int>{1, 3, 6, 7, 8, 9, 10, 12});
+        CHECK(onlyFirst.getPrimes() == vector<int>{3, 7});
+        CHECK(first.size() == 13);
+    }
+
+    SUBCASE("In place, keeping the other indexes current")
+    {
+        MagicalContainer::FilteredIterator<IsEven> even(first);
+        first.enablePrefixSums();
+        first.unionWith(second);
+        CHECK(first.getFiltered<IsEven>() == vector<int>{2, 4, 6, 8, 10, 12, 20});
+        first.intersectWith(second);
+        CHECK(first.getElements() == second.getElements());
+        CHECK(first.getFiltered<IsEven>() == vector<int>{2, 4, 20});
+        CHECK(first.rangeSum(0, 100) == 72);
+        first.differenceFrom(first);
+        CHECK(first.size() == 0);
+        CHECK(first.getPrimes().empty());
+    }
+
+    SUBCASE("Kernels agree with the standard algorithms")
+    {
+        vector<int> large;
+        vector<int> medium;
+        vector<int> small = {-7, 3, 300, 3000, 29999};
+        for (int value = -100; value < 30000; value += 3) {
+            large.push_back(value);
+        }
+        for (int value = -50; value < 20000; value += 7) {
+            medium.push_back(value);
+        }
+        for (const vector<int> *other: {&medium, &small}) {
+            vector<int> expected;
+            set_intersection(large.begin(), large.end(), other->begin(), other->end(), back_inserter(expected));
+            CHECK(intersectSorted(large, *other) == expected);
+            CHECK(intersectSorted(*other, large) == expected);
+        }
+    }
+}
+
+TEST_CASE("Sharded container")
+{
+    SUBCASE("Iterators see one sorted sequence across shards")
+    {
+        ShardedMagicalContainer sharded(4, 0, 99);
+        MagicalContainer single;
+        for (int value: {97, 3, 50, 24, 25, 74, 1, 2, 49, 75, 99, -5, 140}) {
+            sharded.addElement(value);
+            single.addElement(value);
+        }
+        sharded.removeElement(50);
+        single.removeElement(50);
+        CHECK_THROWS(sharded.removeElement(50));
+        CHECK(sharded.shardSizes() == vector<size_t>{5, 2, 1, 4});
+
+        vector<int> ascending;
+        ShardedMagicalContainer::AscendingIterator ascIter(sharded);
+        for (auto it = ascIter.begin(); it != ascIter.end(); ++it) {
+            ascending.push_back(*it);
+        }
+        CHECK(ascending == single.getElements());
+
+        vector<int> primes;
+        ShardedMagicalContainer::PrimeIterator primeIter(sharded);
+        for (auto it = primeIter.begin(); it != primeIter.end(); ++it) {
+            primes.push_back(*it);
+        }
+        CHECK(primes == single.getPrimes());
+
+        vector<int> sharedCross;
+        vector<int> singleCross;
+        ShardedMagicalContainer::SideCrossIterator crossIter(sharded);
+        for (auto it = crossIter.begin(); it != crossIter.end(); ++it) {
+            sharedCross.push_back(*it);
+        }
+        MagicalContainer::SideCrossIterator singleIter(single);
+        for (auto it = singleIter.begin(); it != singleIter.end(); ++it) {
+            singleCross.push_back(*it);
+        }
+        CHECK(sharedCross == singleCross);
+        CHECK_THROWS(++crossIter.end());
+        CHECK_THROWS(*ascIter.end());
+    }
+
+    SUBCASE("Skewed inserts trigger a rebalance")
+    {
+        ShardedMagicalContainer sharded(4, 0, 1 << 20);
+        for (int value = 0; value < 4096; ++value) {
+            sharded.addElement(value);
+        }
+        CHECK(sharded.rebalanceCount() > 0);
+        CHECK(sharded.size() == 4096);
+        vector<int> bounds = sharded.shardLowerBounds();
+        CHECK(bounds[0] == INT_MIN);
+        CHECK(is_sorted(bounds.begin(), bounds.end()));
+        sharded.rebalance();
+        CHECK(sharded.shardSizes() == vector<size_t>{1024, 1024, 1024, 1024});
+        CHECK(sharded.primeCount() == 564);
+    }
+
+    SUBCASE("Concurrent writers")
+    {
+        ShardedMagicalContainer sharded(8, 0, 80000);
+        vector<thread> writers;
+        for (int writer = 0; writer < 4; ++writer) {
+            writers.emplace_back([&sharded, writer] {
+                for (int value = writer; value < 40000; value += 4) {
+                    sharded.addElement(value);
+                }
+            });
+        }
+        for (thread &writer: writers) {
+            writer.join();
+        }
+        unique_ptr<ShardedMagicalContainer> frozen = sharded.snapshot();
+        sharded.removeElement(7);
+        CHECK(sharded.size() == 39999);
+        CHECK(frozen->size() == 40000);
+        vector<int> elements = frozen->getElements();
+        CHECK(elements.size() == 40000);
+        CHECK(is_sorted(elements.begin(), elements.end()));
+        CHECK(elements.back() == 39999);
+    }
+}
+
+TEST_CASE("Bulk load")
+{
+    SUBCASE("Merging runs with a loser tree")
+    {
+        vector<int> first = {-4, 1, 5, 9, 12};
+        vector<int> second = {1, 2, 9, 40};
+        vector<int> third;
+        vector<int> fourth = {0, 12, 13};
+        vector<span<const int>> runs = {first, second, third, fourth};
+        vector<int> expected = {-4, 0, 1, 2, 5, 9, 12, 13, 40};
+        CHECK(mergeSortedRuns(runs, 1) == expected);
+        CHECK(mergeSortedRuns(runs, 3) == expected);
+        CHECK(mergeSortedRuns({}, 2).empty());
+    }
+
+    SUBCASE("Radix sort agrees with std::sort")
+    {
+        mt19937 rng(17);
+        uniform_int_distribution<int> anyInt(INT_MIN, INT_MAX);
+        uniform_int_distribution<int> small(0, 5000);
+        for (size_t size: {size_t{10}, size_t{5000}, size_t{70000}}) {
+            vector<int> wide(size);
+            vector<int> narrow(size);
+            for (size_t i = 0; i < size; ++i) {
+                wide[i] = anyInt(rng);
+                narrow[i] = small(rng);
+            }
+            vector<int> descending(wide);
+            sort(descending.rbegin(), descending.rend());
+            for (vector<int> *batch: {&wide, &narrow, &descending}) {
+                vector<int> expected = *batch;
+                sort(expected.begin(), expected.end());
+                radixSort(*batch);
+                CHECK(*batch == expected);
+                radixSort(*batch);
+                CHECK(*batch == expected);
+            }
+        }
+    }
+
+    SUBCASE("Matches adding one element at a time")
+    {
+        mt19937 rng(5);
+        uniform_int_distribution<int> valueDist(-1000, 1000000);
+        vector<int> values(300000);
+        for (int &value: values) {
+            value = valueDist(rng);
+        }
+        MagicalContainer container;
+        container.addElement(7);
+        container.addElement(-3);
+        container.enablePrefixSums();
+        container.registerFilter<IsEven>();
+        container.addElements(values, 4);
+
+        set<int> expected(values.begin(), values.end());
+        expected.insert({7, -3});
+        CHECK(container.getElements() == vector<int>(expected.begin(), expected.end()));
+        MagicalContainer reference;
+        for (int value: expected) {
+            reference.addElement(value);
+        }
+        CHECK(container.getPrimes() == reference.getPrimes());
+        vector<int> evens;
+        copy_if(expected.begin(), expected.end(), back_inserter(evens), IsEven{});
+        CHECK(container.getFiltered<IsEven>() == evens);
+        CHECK(container.rangeSum(0, 100) == accumulate(expected.lower_bound(0), expected.lower_bound(100), 0LL));
+
+        size_t before = container.size();
+        container.addElements(vector<int>{}, 0);
+        container.addElements(vector<int>{7, 7, -3, evens.front()}, 0);
+        CHECK(container.size() == before);
+        CHECK(container.getFiltered<IsEven>() == evens);
+    }
+}
+
+TEST_CASE("Parallel traversal")
+{
+    MagicalContainer container;
+    vector<int> values(50000);
+    iota(values.begin(), values.end(), -20000);
+    container.addElements(values);
+
+    SUBCASE("Work stealing covers every index once")
+    {
+        vector<atomic<int>> visits(100000);
+        stealingFor(visits.size(), 4, 16, [&](size_t, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                visits[i].fetch_add(1);
+            }
+        });
+        CHECK(all_of(visits.begin(), visits.end(), [](const atomic<int> &count) { return count.load() == 1; }));
+    }
+
+    SUBCASE("for_each and reduce agree with the serial iterators")
+    {
+        for (size_t threads: {size_t{1}, size_t{4}}) {
+            atomic<long long> total{0};
+            container.parallelForEach(MagicalContainer::IteratorType::PRIME,
+                                      [&total](int value) { total += value; }, threads);
+            MagicalContainer::PrimeIterator primes(container);
+            long long expected = 0;
+            for (auto it = primes.begin(); it != primes.end(); ++it) {
+                expected += *it;
+            }
+            CHECK(total == expected);
+            CHECK(container.parallelReduce(MagicalContainer::IteratorType::PRIME, 0LL, plus<long long>(), threads) == expected);
+            CHECK(container.parallelReduce(MagicalContainer::IteratorType::ASCENDING, INT_MIN,
+                                           [](int left, int right) { return max(left, right); }, threads) == 29999);
+        }
+    }
+
+    SUBCASE("Side cross keeps the serial visit order")
+    {
+        // Order-sensitive but associative: keeps a positional hash of the visit sequence.
+        struct Walk {
+            unsigned long long hash = 0;
+            unsigned long long scale = 1;
+            Walk() = default;
+            Walk(int value) : hash(static_cast<unsigned>(value)), scale(31) {}
+        };
+        auto step = [](const Walk &left, const Walk &right) {
+            Walk joined;
+            joined.hash = left.hash * right.scale + right.hash;
+            joined.scale = left.scale * right.scale;
+            return joined;
+        };
+        Walk serial;
+        MagicalContainer::SideCrossIterator cross(container);
+        for (auto it = cross.begin(); it != cross.end(); ++it) {
+            serial = step(serial, Walk(*it));
+        }
+        Walk parallel = container.parallelReduce(MagicalContainer::IteratorType::SIDE_CROSS, Walk(), step, 4);
+        CHECK(parallel.hash == serial.hash);
+        CHECK_THROWS(container.parallelReduce(MagicalContainer::IteratorType::DESCENDING, 0, plus<int>()));
+    }
+}
+
+TEST_CASE("Reductions")
+{
+    SUBCASE("Kernels agree with scalar loops at every tail length")
+    {
+        vector<int> values;
+        for (int i = 0; i < 70; ++i) {
+            values.push_back(i % 3 == 0 ? INT_MAX - i : INT_MIN + i * 7);
+        }
+        for (size_t length = 0; length <= values.size(); ++length) {
+            span<const int> prefix(values.data(), length);
+            CHECK(sumInts(prefix) == accumulate(prefix.begin(), prefix.end(), 0LL));
+            auto odd = static_cast<size_t>(count_if(prefix.begin(), prefix.end(), [](int value) { return value % 2 != 0; }));
+            CHECK(countMasked(prefix, 1, 1) == odd);
+        }
+        CHECK(string(reductionTarget()) != "");
+    }
+
+    SUBCASE("Container sums, counts and histograms per subset")
+    {
+        MagicalContainer container;
+        vector<int> values(1000);
+        iota(values.begin(), values.end(), -100);
+        container.addElements(values);
+        long long primeSum = 0;
+        for (int prime: container.getPrimes()) {
+            primeSum += prime;
+        }
+        CHECK(container.sum() == 399500);
+        CHECK(container.sum(MagicalContainer::Subset::PRIMES) == primeSum);
+        CHECK(container.sum(MagicalContainer::Subset::NON_PRIMES) == 399500 - primeSum);
+        container.enablePrefixSums();
+        CHECK(container.sum(MagicalContainer::Subset::PRIMES) == primeSum);
+
+        CHECK(container.countMasked(1, 0) == 500);
+        CHECK(container.countMasked(1, 0, MagicalContainer::Subset::PRIMES) == 1);
+        CHECK(container.countMasked(1, 1, MagicalContainer::Subset::NON_PRIMES) == 500 - (container.getPrimes().size() - 1));
+
+        CHECK(container.histogram(0, 10, 3) == vector<uint64_t>{10, 10, 10});
+        CHECK(container.histogram(0, 10, 3, MagicalContainer::Subset::PRIMES) == vector<uint64_t>{4, 4, 2});
+        CHECK(container.histogram(0, 10, 3, MagicalContainer::Subset::NON_PRIMES) == vector<uint64_t>{6, 6, 8});
+        CHECK(container.histogram(850, 100, 3) == vector<uint64_t>{50, 0, 0});
+        CHECK(container.histogram(INT_MAX - 5, 10, 2) == vector<uint64_t>{0, 0});
+        CHECK_THROWS(container.histogram(0, 0, 1));
+    }
+}
+
+TEST_CASE("Shared-memory container")
+{
+    string name = "/magical-test-" + to_string(getpid());
+    SharedMagicalContainer writer(name, 64);
+    for (int value: {17, 4, 9, 2, 30, 11, 4}) {
+        writer.addElement(value);
+    }
+    writer.removeElement(9);
+    CHECK_THROWS(writer.removeElement(9));
+    CHECK(writer.size() == 5);
+    CHECK(writer.primeCount() == 3);
+
+    SUBCASE("A second mapping iterates in place in all three orders")
+    {
+        SharedMagicalContainer reader(name);
+        CHECK_FALSE(reader.isWriter());
+        CHECK_THROWS(reader.addElement(5));
+
+        vector<int> ascending;
+        SharedMagicalContainer::AscendingIterator ascIter(reader);
+        for (auto it = ascIter.begin(); it != ascIter.end(); ++it) {
+            ascending.push_back(*it);
+        }
+        CHECK(ascending == vector<int>{2, 4, 11, 17, 30});
+
+        vector<int> primes;
+        SharedMagicalContainer::PrimeIterator primeIter(reader);
+        for (auto it = primeIter.begin(); it != primeIter.end(); ++it) {
+            primes.push_back(*it);
+        }
+        CHECK(primes == vector<int>{2, 11, 17});
+
+        vector<int> cross;
+        SharedMagicalContainer::SideCrossIterator crossIter(reader);
+        for (auto it = crossIter.begin(); it != crossIter.end(); ++it) {
+            cross.push_back(*it);
+        }
+        CHECK(cross == vector<int>{2, 30, 4, 17, 11});
+        CHECK(reader.snapshot().getElements() == ascending);
+    }
+
+    SUBCASE("Iterators detect writes after they were created")
+    {
+        SharedMagicalContainer reader(name);
+        SharedMagicalContainer::AscendingIterator before(reader);
+        uint64_t epoch = reader.epoch();
+        writer.addElement(3);
+        CHECK(reader.epoch() == epoch + 1);
+        CHECK_THROWS(*before);
+        SharedMagicalContainer::AscendingIterator after(reader);
+        CHECK(*after == 2);
+        CHECK(reader.primeCount() == 4);
+    }
+
+    SUBCASE("Another process reads the same segment")
+    {
+        pid_t child = fork();
+        if (child == 0) {
+            SharedMagicalContainer reader(name);
+            long long total = 0;
+            SharedMagicalContainer::AscendingIterator it(reader);
+            for (auto current = it.begin(); current != it.end(); ++current) {
+                total += *current;
+            }
+            _exit(total == 64 ? 0 : 1);
+        }
+        int status = 0;
+        waitpid(child, &status, 0);
+        CHECK(WIFEXITED(status));
+        CHECK(WEXITSTATUS(status) == 0);
+    }
+
+    SUBCASE("The segment has a fixed capacity")
+    {
+        SharedMagicalContainer small(name + "-small", 2);
+        small.addElement(1);
+        small.addElement(2);
+        small.addElement(2);
+        CHECK_THROWS(small.addElement(3));
+    }
+
+    SUBCASE("A corrupt header or count is rejected")
+    {
+        int fd = shm_open(name.c_str(), O_RDWR, 0);
+        REQUIRE(fd >= 0);
+        struct stat info {};
+        REQUIRE(fstat(fd, &info) == 0);
+        auto bytes = static_cast<size_t>(info.st_size);
+        void *raw = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        REQUIRE(raw != MAP_FAILED);
+        // Header: magic, capacity, elementsOffset, primesOffset, sequence, elementCount, primeCount.
+        auto *fields = static_cast<uint64_t *>(raw);
+        uint64_t elementsOffset = fields[2];
+
+        fields[2] = fields[3] - 8;
+        CHECK_THROWS_WITH(SharedMagicalContainer{name}, ("Not a MagicalContainer segment: " + name).c_str());
+        fields[2] = bytes;
+        CHECK_THROWS(SharedMagicalContainer{name});
+        fields[2] = elementsOffset;
+
+        SharedMagicalContainer reader(name);
+        fields[5] = fields[1] + 1;
+        CHECK_THROWS_WITH(reader.size(), ("Corrupt shared container: " + name).c_str());
+        CHECK_THROWS(SharedMagicalContainer::AscendingIterator{reader});
+        fields[5] = 5;
+        CHECK(reader.size() == 5);
+        munmap(raw, bytes);
+    }
+}
+
+TEST_CASE("Saving and loading")
+{
+    auto roundTrip = [](const MagicalContainer &container) {
+        FILE *file = tmpfile();
+        REQUIRE(file != nullptr);
+        container.save(fileno(file));
+        lseek(fileno(file), 0, SEEK_SET);
+        MagicalContainer loaded = MagicalContainer::load(fileno(file));
+        fclose(file);
+        return loaded;
+    };
+
+    SUBCASE("Delta codec at every tail length")
+    {
+        for (size_t count = 1; count <= 9; ++count) {
+            vector<int> values;
+            for (size_t i = 0; i < count; ++i) {
+                values.push_back(INT_MIN + static_cast<int>(i * i * 40000));
+            }
+            values.back() = INT_MAX;
+            vector<uint8_t> encoded;
+            encodeDeltas(values, values[0], encoded);
+            size_t length = encoded.size();
+            CHECK(encodedDeltaBytes(encoded.data(), length, count) == length);
+            encoded.resize(length + DECODE_SLACK);
+            vector<int> decoded(count);
+            CHECK(decodeDeltas(encoded.data(), count, values[0], decoded.data()) == length);
+            CHECK(decoded == values);
+        }
+        const uint8_t text[] = "123456789";
+        CHECK(crc32c(text, 9) == 0xE3069283U);
+    }
+
+    SUBCASE("Round trip across several blocks")
+    {
+        MagicalContainer container;
+        vector<int> values;
+        for (int value = -70000; value < 130000; value += 2) {
+            values.push_back(value);
+        }
+        values.push_back(INT_MIN);
+        values.push_back(INT_MAX);
+        values.push_back(3);
+        container.addElements(values);
+        MagicalContainer loaded = roundTrip(container);
+        CHECK(loaded.getElements() == container.getElements());
+        CHECK(loaded.getPrimes() == container.getPrimes());
+        CHECK(roundTrip(MagicalContainer()).size() == 0);
+    }
+
+    SUBCASE("Damaged files are rejected")
+    {
+        MagicalContainer container;
+        for (int value: {1, 2, 3, 5, 8, 13}) {
+            container.addElement(value);
+        }
+        FILE *file = tmpfile();
+        REQUIRE(file != nullptr);
+        container.save(fileno(file));
+        vector<uint8_t> bytes(static_cast<size_t>(lseek(fileno(file), 0, SEEK_END)));
+        lseek(fileno(file), 0, SEEK_SET);
+        REQUIRE(read(fileno(file), bytes.data(), bytes.size()) == static_cast<ssize_t>(bytes.size()));
+        fclose(file);
+
+        auto loadBytes = [](const vector<uint8_t> &data) {
+            FILE *copy = tmpfile();
+            REQUIRE(copy != nullptr);
+            fwrite(data.data(), 1, data.size(), copy);
+            fflush(copy);
+            lseek(fileno(copy), 0, SEEK_SET);
+            try {
+                MagicalContainer loaded = MagicalContainer::load(fileno(copy));
+                fclose(copy);
+                return loaded.size();
+            } catch (...) {
+                fclose(copy);
+                throw;
+            }
+        };
+        CHECK(loadBytes(bytes) == 6);
+
+        vector<uint8_t> flipped = bytes;
+        flipped[bytes.size() - 2] ^= 0x10;
+        CHECK_THROWS_WITH(loadBytes(flipped), "Corrupt container file: block checksum mismatch");
+        vector<uint8_t> newer = bytes;
+        newer[4] = 2;
+        CHECK_THROWS_WITH(loadBytes(newer), "Unsupported container file version 2");
+        CHECK_THROWS(loadBytes(vector<uint8_t>(bytes.begin(), bytes.end() - 1)));
+
+        // Damage that the checksums do not catch, because they are recomputed over it.
+        auto reseal = [](vector<uint8_t> data) {
+            uint32_t headerCrc = crc32c(data.data(), 28);
+            memcpy(data.data() + 28, &headerCrc, sizeof(headerCrc));
+            uint32_t blockCrc = crc32c(data.data() + 48, data.size() - 48);
+            memcpy(data.data() + 44, &blockCrc, sizeof(blockCrc));
+            return data;
+        };
+        vector<uint8_t> repeated = bytes;
+        repeated[48 + 3] = 0;
+        CHECK_THROWS_WITH(loadBytes(reseal(repeated)), "Corrupt container file: values out of order");
+        vector<uint8_t> padded = bytes;
+        padded.back() |= 0x40;
+        CHECK_THROWS_WITH(loadBytes(reseal(padded)), "Corrupt container file: bitmap padding set");
+        vector<uint8_t> huge = bytes;
+        uint64_t elementCount = uint64_t{1} << 60;
+        memcpy(huge.data() + 12, &elementCount, sizeof(elementCount));
+        CHECK_THROWS_WITH(loadBytes(reseal(huge)), "Corrupt container file: element count exceeds file size");
+    }
+}
+
+TEST_CASE("Write-ahead log")
+{
+    char pattern[] = "/tmp/magical-wal-XXXXXX";
+    REQUIRE(mkdtemp(pattern) != nullptr);
+    string directory = pattern;
+
+    SUBCASE("Bulk removal ignores absent values")
+    {
+        MagicalContainer container;
+        container.addElements(vector<int>{1, 2, 3, 4, 5, 6, 7});
+        container.removeElements(vector<int>{7, 2, 2, 100, 4});
+        CHECK(container.getElements() == vector<int>{1, 3, 5, 6});
+        CHECK(container.getPrimes() == vector<int>{3, 5});
+    }
+
+    SUBCASE("Reopening replays adds and removes in order")
+    {
+        {
+            DurableMagicalContainer durable(directory);
+            durable.addElements(vector<int>{2, 4, 6, 7, 9, 11});
+            durable.removeElement(7);
+            durable.addElement(7);
+            durable.removeElement(4);
+            durable.removeElements(vector<int>{9, 11});
+            durable.addElement(13);
+            CHECK_THROWS(durable.removeElement(100));
+            CHECK(durable.get().getElements() == vector<int>{2, 6, 7, 13});
+        }
+        DurableMagicalContainer reopened(directory);
+        CHECK(reopened.replayedRecords() == 12);
+        CHECK(reopened.get().getElements() == vector<int>{2, 6, 7, 13});
+        CHECK(reopened.get().getPrimes() == vector<int>{2, 7, 13});
+        reopened.removeElement(2);
+        reopened.sync();
+        CHECK(DurableMagicalContainer(directory).get().getElements() == vector<int>{6, 7, 13});
+    }
+
+    SUBCASE("A failed log leaves the container unchanged")
+    {
+        // The file size limit is per process, so the log fails in a child.
+        pid_t child = fork();
+        if (child == 0) {
+            signal(SIGXFSZ, SIG_IGN);
+            rlimit limit{64, 64};
+            setrlimit(RLIMIT_FSIZE, &limit);
+            DurableMagicalContainer durable(directory);
+            durable.addElements(vector<int>(100, 5));
+            bool failed = false;
+            try {
+                durable.sync();
+            } catch (const runtime_error &) {
+                failed = true;
+            }
+            try {
+                durable.addElement(7);
+                failed = false;
+            } catch (const runtime_error &) {
+            }
+            _exit(failed && durable.size() == 1 && durable.get().getElements() == vector<int>{5} ? 0 : 1);
+        }
+        int status = 0;
+        waitpid(child, &status, 0);
+        CHECK(WIFEXITED(status));
+        CHECK(WEXITSTATUS(status) == 0);
+    }
+
+    SUBCASE("Group commit batches records into few syncs")
+    {
+        WriteAheadLog log(directory + "/batched.log", {chrono::seconds(10), 100});
+        for (int value = 0; value < 250; ++value) {
+            log.append(LogOp::ADD, value);
+        }
+        // Two full batches are flushed without waiting out the ten-second budget.
+        log.waitDurable(200);
+        CHECK(log.durable() >= 200);
+        log.sync();
+        CHECK(log.durable() == 250);
+        CHECK(log.syncCount() >= 1);
+        CHECK(log.syncCount() <= 3);
+
+        WriteAheadLog timed(directory + "/timed.log", {chrono::milliseconds(2), 1000000});
+        timed.waitDurable(timed.append(LogOp::REMOVE, -1));
+        CHECK(timed.durable() == 1);
+        size_t frames = 0;
+        CHECK(WriteAheadLog::read(directory + "/timed.log", [&frames](const vector<LogRecord> &frame) {
+            ++frames;
+            CHECK(frame.size() == 1);
+            CHECK(frame[0].op == LogOp::REMOVE);
+            CHECK(frame[0].value == -1);
+        }) == 1);
+        CHECK(frames == 1);
+    }
+
+    SUBCASE("A torn tail is dropped and overwritten")
+    {
+        string segment;
+        {
+            DurableMagicalContainer durable(directory);
+            durable.addElements(vector<int>{1, 2, 3});
+            segment = durable.getLog().getPath();
+        }
+        FILE *file = fopen(segment.c_str(), "ab");
+        REQUIRE(file != nullptr);
+        const uint8_t torn[] = {10, 0, 0, 0, 1, 2, 3, 4, 1};
+        fwrite(torn, 1, sizeof(torn), file);
+        fclose(file);
+        {
+            DurableMagicalContainer durable(directory);
+            CHECK(durable.replayedRecords() == 3);
+            durable.addElement(5);
+        }
+        DurableMagicalContainer reopened(directory);
+        CHECK(reopened.replayedRecords() == 4);
+        CHECK(reopened.get().getElements() == vector<int>{1, 2, 3, 5});
+    }
+
+    SUBCASE("Checkpoints bound what is replayed")
+    {
+        DurableMagicalContainer::Options options;
+        options.checkpointRecords = 1000;
+        set<int> expected;
+        {
+            DurableMagicalContainer durable(directory, options);
+            for (int value = 0; value < 5000; ++value) {
+                durable.addElement(value);
+                expected.insert(value);
+                if (value % 7 == 0) {
+                    durable.removeElement(value / 2);
+                    expected.erase(value / 2);
+                }
+                // Bound how long one checkpoint can run, so a slow disk cannot stretch it over the loop.
+                if (value % 1000 == 999) {
+                    durable.waitForCheckpoint();
+                }
+            }
+            CHECK(durable.checkpointSegment() >= 4);
+            durable.waitForCheckpoint();
+        }
+        FILE *stale = fopen((directory + "/checkpoint.tmp").c_str(), "wb");
+        REQUIRE(stale != nullptr);
+        fputs("interrupted", stale);
+        fclose(stale);
+
+        DurableMagicalContainer reopened(directory, options);
+        // A checkpoint starts once 1000 records are logged and none is running. One still running
+        // is joined within 1000 values, at most 1143 records, so fewer than 1000 + 1143 remain.
+        CHECK(reopened.replayedRecords() < 2200);
+        CHECK(reopened.get().getElements() == vector<int>(expected.begin(), expected.end()));
+        size_t checkpoints = 0;
+        for (const auto &entry: filesystem::directory_iterator(directory)) {
+            string name = entry.path().filename().string();
+            if (name.starts_with("checkpoint")) {
+                ++checkpoints;
+            }
+            if (name.starts_with("wal-")) {
+                CHECK(stoull(name.substr(4)) > reopened.checkpointSegment());
+            }
+        }
+        CHECK(checkpoints == 1);
+    }
+
+    SUBCASE("Mutations continue while a checkpoint is written")
+    {
+        {
+            DurableMagicalContainer durable(directory);
+            vector<int> values(100000);
+            iota(values.begin(), values.end(), 0);
+            durable.addElements(values);
+            durable.checkpoint();
+            durable.removeElements(vector<int>{0, 1, 2});
+            durable.addElement(-5);
+            durable.waitForCheckpoint();
+            CHECK(durable.size() == 99998);
+        }
+        DurableMagicalContainer reopened(directory);
+        CHECK(reopened.checkpointSegment() == 1);
+        CHECK(reopened.replayedRecords() == 4);
+        CHECK(reopened.size() == 99998);
+        CHECK(reopened.get().getElements().front() == -5);
+        CHECK(reopened.get().getElements()[1] == 3);
+    }
+
+    SUBCASE("A failed automatic checkpoint does not fail the mutation")
+    {
+        DurableMagicalContainer::Options options;
+        options.checkpointRecords = 10;
+        {
+            DurableMagicalContainer durable(directory, options);
+            // A non-empty directory where the checkpoint file goes makes every checkpoint fail.
+            filesystem::create_directories(directory + "/checkpoint.tmp/blocker");
+            for (int value = 0; value < 50; ++value) {
+                CHECK_NOTHROW(durable.addElement(value));
+                // Let each failed checkpoint finish, so the next mutation reaps it.
+                this_thread::sleep_for(chrono::milliseconds(2));
+            }
+            CHECK_THROWS(durable.waitForCheckpoint());
+            CHECK_NOTHROW(durable.waitForCheckpoint());
+            CHECK(durable.size() == 50);
+
+            filesystem::remove_all(directory + "/checkpoint.tmp");
+            durable.checkpoint();
+            CHECK_NOTHROW(durable.waitForCheckpoint());
+        }
+        DurableMagicalContainer reopened(directory, options);
+        CHECK(reopened.size() == 50);
+        CHECK(reopened.replayedRecords() == 0);
+    }
+
+    filesystem::remove_all(directory);
+}
+
+TEST_CASE("C interface")
+{
+    SUBCASE("Versions change with every mutation and never repeat")
+    {
+        MagicalContainer container;
+        MagicalContainer other;
+        CHECK(container.version() != other.version());
+        uint64_t before = container.version();
+        container.addElement(4);
+        CHECK(container.version() != before);
+        MagicalContainer copy = container.snapshot();
+        CHECK(copy.version() == container.version());
+        copy.addElement(5);
+        CHECK(copy.version() != container.version());
+        before = container.version();
+        container.removeElements(vector<int>{4});
+        CHECK(container.version() != before);
+    }
+
+    SUBCASE("Views borrow the storage without copying")
+    {
+        magical_container *container = magical_create();
+        REQUIRE(container != nullptr);
+        const int32_t values[] = {10, 3, 7, 4, 3, 2, 13};
+        CHECK(magical_add_many(container, values, 7) == MAGICAL_OK);
+        CHECK(magical_size(container) == 6);
+        CHECK(magical_prime_count(container) == 4);
+
+        magical_view all;
+        magical_view primes;
+        REQUIRE(magical_borrow_ascending(container, &all) == MAGICAL_OK);
+        REQUIRE(magical_borrow_primes(container, &primes) == MAGICAL_OK);
+        CHECK(vector<int>(all.data, all.data + all.length) == vector<int>{2, 3, 4, 7, 10, 13});
+        CHECK(vector<int>(primes.data, primes.data + primes.length) == vector<int>{2, 3, 7, 13});
+        CHECK(magical_view_valid(container, &all) == 1);
+        CHECK(all.version == magical_version(container));
+
+        CHECK(magical_remove(container, 4) == MAGICAL_OK);
+        CHECK(magical_view_valid(container, &all) == 0);
+        CHECK(magical_view_valid(container, &primes) == 0);
+        CHECK(magical_remove(container, 4) == MAGICAL_NOT_FOUND);
+
+        const int32_t gone[] = {2, 99};
+        CHECK(magical_remove_many(container, gone, 2) == MAGICAL_OK);
+        REQUIRE(magical_borrow_ascending(container, &all) == MAGICAL_OK);
+        CHECK(vector<int>(all.data, all.data + all.length) == vector<int>{3, 7, 10, 13});
+        magical_destroy(container);
+    }
+
+    SUBCASE("Null arguments are rejected")
+    {
+        magical_view view;
+        CHECK(magical_add(nullptr, 1) == MAGICAL_INVALID_ARGUMENT);
+        CHECK(magical_borrow_ascending(nullptr, &view) == MAGICAL_INVALID_ARGUMENT);
+        magical_container *container = magical_create();
+        CHECK(magical_add_many(container, nullptr, 3) == MAGICAL_INVALID_ARGUMENT);
+        CHECK(magical_add_many(container, nullptr, 0) == MAGICAL_OK);
+        CHECK(magical_borrow_primes(container, nullptr) == MAGICAL_INVALID_ARGUMENT);
+        CHECK(magical_view_valid(container, nullptr) == 0);
+        CHECK(magical_abi_version() == MAGICAL_ABI_VERSION);
+        magical_destroy(container);
+        magical_destroy(nullptr);
+    }
+}
+
+TEST_CASE("Arrow C Data Interface")
+{
+    MagicalContainer container;
+    container.addElements(vector<int>{1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11});
+    auto bit = [](const void *bitmap, size_t index) {
+        return ((static_cast<const uint8_t *>(bitmap)[index / 8] >> (index % 8)) & 1U) != 0;
+    };
+
+    SUBCASE("Export shares the ascending storage")
+    {
+        ArrowSchema schema;
+        ArrowArray array;
+        container.exportArrow(&schema, &array, MagicalContainer::ArrowPrimes::NONE);
+        CHECK(string(schema.format) == "i");
+        CHECK(array.length == 11);
+        CHECK(array.null_count == 0);
+        CHECK(array.n_buffers == 2);
+        CHECK(array.buffers[0] == nullptr);
+        CHECK(array.buffers[1] == container.getElements().data());
+
+        // The export keeps the old storage alive; the container copies before writing.
+        container.removeElement(1);
+        container.addElement(12);
+        const int *data = static_cast<const int *>(array.buffers[1]);
+        CHECK(vector<int>(data, data + array.length) == vector<int>{1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11});
+        array.release(&array);
+        schema.release(&schema);
+        CHECK(array.release == nullptr);
+        CHECK(schema.release == nullptr);
+    }
+
+    SUBCASE("Primes as a validity bitmap")
+    {
+        ArrowSchema schema;
+        ArrowArray array;
+        container.exportArrow(&schema, &array, MagicalContainer::ArrowPrimes::VALIDITY);
+        CHECK((schema.flags & ARROW_FLAG_NULLABLE) != 0);
+        CHECK(array.null_count == 6);
+        vector<int> valid;
+        for (size_t i = 0; i < static_cast<size_t>(array.length); ++i) {
+            if (bit(array.buffers[0], i)) {
+                valid.push_back(static_cast<const int *>(array.buffers[1])[i]);
+            }
+        }
+        CHECK(valid == container.getPrimes());
+
+        // Importing it back keeps only the valid slots: the primes.
+        MagicalContainer primesOnly;
+        primesOnly.importArrow(&schema, &array);
+        CHECK(array.release == nullptr);
+        CHECK(schema.release == nullptr);
+        CHECK(primesOnly.getElements() == vector<int>{2, 3, 5, 7, 11});
+    }
+
+    SUBCASE("Primes as a boolean column")
+    {
+        ArrowSchema schema;
+        ArrowArray array;
+        container.exportArrow(&schema, &array);
+        REQUIRE(schema.n_children == 2);
+        REQUIRE(array.n_children == 2);
+        CHECK(string(schema.format) == "+s");
+        CHECK(string(schema.children[0]->name) == "value");
+        CHECK(string(schema.children[1]->format) == "b");
+        CHECK(array.children[0]->buffers[1] == container.getElements().data());
+        for (size_t i = 0; i < 11; ++i) {
+            bool prime = find(container.getPrimes().begin(), container.getPrimes().end(),
+                              container.getElements()[i]) != container.getPrimes().end();
+            CHECK(bit(array.children[1]->buffers[1], i) == prime);
+        }
+
+        // A consumer may move a child out and release it after the parent.
+        ArrowArray moved = *array.children[1];
+        array.children[1]->release = nullptr;
+        array.release(&array);
+        CHECK(bit(moved.buffers[1], 1));
+        moved.release(&moved);
+        schema.release(&schema);
+    }
+
+    SUBCASE("Import of unsorted values with an offset and nulls")
+    {
+        int32_t values[] = {99, 40, 7, -3, 40, 12, 5};
+        uint8_t validity[] = {0b1011110};
+        const void *buffers[] = {validity, values};
+        int released = 0;
+        ArrowArray array{6, 1, 1, 2, 0, buffers, nullptr, nullptr,
+                         [](ArrowArray *self) {
+                             ++*static_cast<int *>(self->private_data);
+                             self->release = nullptr;
+                         }, &released};
+        ArrowSchema schema{"i", "input", nullptr, ARROW_FLAG_NULLABLE, 0, nullptr, nullptr,
+                           [](ArrowSchema *self) { self->release = nullptr; }, nullptr};
+        MagicalContainer imported;
+        imported.addElement(1000);
+        imported.importArrow(&schema, &array);
+        CHECK(released == 1);
+        CHECK(imported.getElements() == vector<int>{-3, 5, 7, 40, 1000});
+        CHECK(imported.getPrimes() == vector<int>{5, 7});
+
+        ArrowSchema wrong{"l", "input", nullptr, 0, 0, nullptr, nullptr,
+                          [](ArrowSchema *self) { self->release = nullptr; }, nullptr};
+        ArrowArray unused{0, 0, 0, 2, 0, buffers, nullptr, nullptr,
+                          [](ArrowArray *self) { self->release = nullptr; }, nullptr};
+        CHECK_THROWS_WITH(imported.importArrow(&wrong, &unused), "Arrow import needs an int32 array, got format \"l\"");
+        CHECK(wrong.release == nullptr);
+        CHECK(unused.release == nullptr);
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef MAGICAL_ITERATORS_ARROWCDATA_H
+#define MAGICAL_ITERATORS_ARROWCDATA_H
+
+/*
+ * The Arrow C Data Interface structures, as specified at
+ * https://arrow.apache.org/docs/format/CDataInterface.html, so containers can be exchanged
+ * with Arrow-based tools without linking the Arrow library. The ARROW_C_DATA_INTERFACE guard
+ * is the one the specification prescribes, so this header coexists with Arrow's own.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+    const char *format;
+    const char *name;
+    const char *metadata;
+    int64_t flags;
+    int64_t n_children;
+    struct ArrowSchema **children;
+    struct ArrowSchema *dictionary;
+    void (*release)(struct ArrowSchema *);
+    void *private_data;
+};
+
+struct ArrowArray {
+    int64_t length;
+    int64_t null_count;
+    int64_t offset;
+    int64_t n_buffers;
+    int64_t n_children;
+    const void **buffers;
+    struct ArrowArray **children;
+    struct ArrowArray *dictionary;
+    void (*release)(struct ArrowArray *);
+    void *private_data;
+};
+
+#endif /* ARROW_C_DATA_INTERFACE */
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* MAGICAL_ITERATORS_ARROWCDATA_H */
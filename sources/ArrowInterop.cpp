@@ -0,0 +1,169 @@
+#include "MagicalContainer.hpp"
+
+#include <array>
+#include <cstring>
+
+using namespace ariel;
+
+namespace {
+
+    // Keeps alive everything an exported ArrowArray points at; freed by its release callback.
+    // Children are released through their own callbacks, since a consumer may move one out.
+    struct ExportedArray {
+        shared_ptr<vector<int>> elements;
+        shared_ptr<vector<uint8_t>> bitmap;
+        array<const void *, 2> buffers{};
+        array<ArrowArray, 2> children{};
+        array<ArrowArray *, 2> childPointers{};
+    };
+
+    struct ExportedSchema {
+        array<ArrowSchema, 2> children{};
+        array<ArrowSchema *, 2> childPointers{};
+    };
+
+    void releaseArray(ArrowArray *array) {
+        for (int64_t child = 0; child < array->n_children; ++child) {
+            ArrowArray *owned = array->children[child];
+            if (owned->release != nullptr) {
+                owned->release(owned);
+            }
+        }
+        delete static_cast<ExportedArray *>(array->private_data);
+        array->release = nullptr;
+    }
+
+    void releaseSchema(ArrowSchema *schema) {
+        for (int64_t child = 0; child < schema->n_children; ++child) {
+            ArrowSchema *owned = schema->children[child];
+            if (owned->release != nullptr) {
+                owned->release(owned);
+            }
+        }
+        delete static_cast<ExportedSchema *>(schema->private_data);
+        schema->release = nullptr;
+    }
+
+    // Fills `out` with a two-buffer (validity, data) array, or a buffer-less struct array if children > 0.
+    void fillArray(ArrowArray *out, ExportedArray *owned, size_t length, size_t nullCount, int64_t children) {
+        *out = ArrowArray{};
+        out->length = static_cast<int64_t>(length);
+        out->null_count = static_cast<int64_t>(nullCount);
+        out->n_buffers = children > 0 ? 1 : 2;
+        out->n_children = children;
+        out->buffers = owned->buffers.data();
+        out->children = children > 0 ? owned->childPointers.data() : nullptr;
+        out->release = releaseArray;
+        out->private_data = owned;
+    }
+
+    void fillSchema(ArrowSchema *out, ExportedSchema *owned, const char *format, const char *name, int64_t flags,
+                    int64_t children) {
+        *out = ArrowSchema{};
+        out->format = format;
+        out->name = name;
+        out->flags = flags;
+        out->n_children = children;
+        out->children = children > 0 ? owned->childPointers.data() : nullptr;
+        out->release = releaseSchema;
+        out->private_data = owned;
+    }
+
+    // Bit i set when elements[i] is prime, least significant bit first as Arrow lays bitmaps out.
+    shared_ptr<vector<uint8_t>> primeBitmap(const vector<int> &elements, const vector<int> &primes) {
+        auto bitmap = make_shared<vector<uint8_t>>((elements.size() + 7) / 8, 0);
+        size_t at = 0;
+        for (int prime: primes) {
+            while (elements[at] < prime) {
+                ++at;
+            }
+            (*bitmap)[at / 8] |= static_cast<uint8_t>(1U << (at % 8));
+        }
+        return bitmap;
+    }
+}
+
+void MagicalContainer::exportArrow(ArrowSchema *schema, ArrowArray *array, ArrowPrimes primes) const {
+    size_t length = vecElements->size();
+    auto ownedArray = make_unique<ExportedArray>();
+    auto ownedSchema = make_unique<ExportedSchema>();
+    ownedArray->elements = vecElements;
+    if (primes != ArrowPrimes::NONE) {
+        ownedArray->bitmap = primeBitmap(*vecElements, *vecPrime);
+    }
+
+    if (primes != ArrowPrimes::COLUMN) {
+        bool validity = primes == ArrowPrimes::VALIDITY;
+        ownedArray->buffers = {validity ? ownedArray->bitmap->data() : nullptr, vecElements->data()};
+        fillArray(array, ownedArray.release(), length, validity ? length - vecPrime->size() : 0, 0);
+        fillSchema(schema, ownedSchema.release(), "i", "ascending", validity ? ARROW_FLAG_NULLABLE : 0, 0);
+        return;
+    }
+
+    auto values = make_unique<ExportedArray>();
+    values->elements = vecElements;
+    values->buffers = {nullptr, vecElements->data()};
+    auto flags = make_unique<ExportedArray>();
+    flags->bitmap = ownedArray->bitmap;
+    flags->buffers = {nullptr, flags->bitmap->data()};
+    auto valueSchema = make_unique<ExportedSchema>();
+    auto primeSchema = make_unique<ExportedSchema>();
+
+    // Nothing below allocates, so ownership passes to the release callbacks all at once.
+    fillArray(&ownedArray->children[0], values.release(), length, 0, 0);
+    fillArray(&ownedArray->children[1], flags.release(), length, 0, 0);
+    ownedArray->childPointers = {&ownedArray->children[0], &ownedArray->children[1]};
+    ownedArray->buffers = {nullptr, nullptr};
+    fillArray(array, ownedArray.release(), length, 0, 2);
+
+    fillSchema(&ownedSchema->children[0], valueSchema.release(), "i", "value", 0, 0);
+    fillSchema(&ownedSchema->children[1], primeSchema.release(), "b", "prime", 0, 0);
+    ownedSchema->childPointers = {&ownedSchema->children[0], &ownedSchema->children[1]};
+    fillSchema(schema, ownedSchema.release(), "+s", "ascending", 0, 2);
+}
+
+void MagicalContainer::importArrow(ArrowSchema *schema, ArrowArray *array, size_t threads) {
+    // The structures are ours from here on, whatever happens.
+    struct Release {
+        ArrowSchema *schema;
+        ArrowArray *array;
+        ~Release() {
+            if (array != nullptr && array->release != nullptr) {
+                array->release(array);
+            }
+            if (schema != nullptr && schema->release != nullptr) {
+                schema->release(schema);
+            }
+        }
+    } release{schema, array};
+
+    if (schema == nullptr || array == nullptr || schema->release == nullptr || array->release == nullptr) {
+        throw runtime_error("Arrow import of a missing or released structure");
+    }
+    if (schema->format == nullptr || strcmp(schema->format, "i") != 0) {
+        throw runtime_error(string("Arrow import needs an int32 array, got format \"") +
+                            (schema->format == nullptr ? "" : schema->format) + "\"");
+    }
+    if (array->n_buffers != 2 || array->length < 0 || array->offset < 0) {
+        throw runtime_error("Arrow import of a malformed int32 array");
+    }
+    auto length = static_cast<size_t>(array->length);
+    auto offset = static_cast<size_t>(array->offset);
+    const int *values = static_cast<const int *>(array->buffers[1]);
+    const auto *validity = static_cast<const uint8_t *>(array->buffers[0]);
+    if (length == 0) {
+        return;
+    }
+    if (validity == nullptr || array->null_count == 0) {
+        addElements(span<const int>(values + offset, length), threads);
+        return;
+    }
+    vector<int> present;
+    present.reserve(array->null_count > 0 ? length - static_cast<size_t>(array->null_count) : length);
+    for (size_t i = offset; i < offset + length; ++i) {
+        if (((validity[i / 8] >> (i % 8)) & 1U) != 0) {
+            present.push_back(values[i]);
+        }
+    }
+    addElements(present, threads);
+}
@@ -0,0 +1,286 @@
+#include "BulkLoad.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+namespace {
+    // Samples taken from each run per output slice when choosing splitters.
+    constexpr size_t OVERSAMPLE = 16;
+
+    // Values cutting the merged output into at most `parts` slices of similar size.
+    vector<int> chooseSplitters(const vector<span<const int>> &runs, size_t parts) {
+        vector<int> sample;
+        for (span<const int> run: runs) {
+            size_t step = max<size_t>(1, run.size() / (parts * OVERSAMPLE));
+            for (size_t i = step / 2; i < run.size(); i += step) {
+                sample.push_back(run[i]);
+            }
+        }
+        sort(sample.begin(), sample.end());
+        vector<int> splitters;
+        for (size_t part = 1; part < parts && !sample.empty(); ++part) {
+            int splitter = sample[part * sample.size() / parts];
+            if (splitters.empty() || splitter > splitters.back()) {
+                splitters.push_back(splitter);
+            }
+        }
+        return splitters;
+    }
+
+    constexpr unsigned DIGIT_BITS = 11;
+    constexpr size_t DIGIT_VALUES = size_t{1} << DIGIT_BITS;
+    constexpr unsigned DIGIT_PASSES = (32 + DIGIT_BITS - 1) / DIGIT_BITS;
+
+    // Flipping the sign bit makes unsigned order match signed order.
+    uint32_t keyOf(int value) {
+        return static_cast<uint32_t>(value) ^ 0x80000000U;
+    }
+
+    size_t digitOf(int value, unsigned pass) {
+        return (keyOf(value) >> (pass * DIGIT_BITS)) & (DIGIT_VALUES - 1);
+    }
+
+    // One worker's unclaimed items [begin, end); the owner takes from the front, thieves from the back.
+    struct alignas(64) StealRange {
+        mutex lock;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    const int *lowerBound(span<const int> run, int value) {
+        return lower_bound(run.data(), run.data() + run.size(), value);
+    }
+}
+
+namespace ariel {
+
+    size_t bulkThreadCount(size_t count, size_t requested) {
+        size_t threads = requested != 0 ? requested : max(1U, thread::hardware_concurrency());
+        return max<size_t>(1, min(threads, count / BULK_MIN_PER_THREAD));
+    }
+
+    void radixSort(span<int> values) {
+        if (values.size() < RADIX_SORT_MIN) {
+            sort(values.begin(), values.end());
+            return;
+        }
+        if (is_sorted(values.begin(), values.end())) {
+            return;
+        }
+        // All digit histograms in one read of the input; 2048 counters per pass stay cache resident.
+        vector<array<size_t, DIGIT_VALUES>> counts(DIGIT_PASSES);
+        for (int value: values) {
+            for (unsigned pass = 0; pass < DIGIT_PASSES; ++pass) {
+                ++counts[pass][digitOf(value, pass)];
+            }
+        }
+
+        vector<int> buffer(values.size());
+        span<int> source = values;
+        span<int> target = buffer;
+        for (unsigned pass = 0; pass < DIGIT_PASSES; ++pass) {
+            array<size_t, DIGIT_VALUES> &offsets = counts[pass];
+            if (offsets[digitOf(source[0], pass)] == source.size()) {
+                continue;
+            }
+            size_t next = 0;
+            for (size_t &offset: offsets) {
+                size_t count = offset;
+                offset = next;
+                next += count;
+            }
+            for (int value: source) {
+                target[offsets[digitOf(value, pass)]++] = value;
+            }
+            swap(source, target);
+        }
+        if (source.data() != values.data()) {
+            copy(source.begin(), source.end(), values.begin());
+        }
+    }
+
+    void parallelFor(size_t tasks, size_t threads, const function<void(size_t)> &task) {
+        threads = min(threads, tasks);
+        if (threads <= 1) {
+            for (size_t i = 0; i < tasks; ++i) {
+                task(i);
+            }
+            return;
+        }
+        atomic<size_t> next{0};
+        mutex failureLock;
+        exception_ptr failure;
+        auto worker = [&] {
+            try {
+                for (size_t i; (i = next.fetch_add(1, memory_order_relaxed)) < tasks;) {
+                    task(i);
+                }
+            } catch (...) {
+                lock_guard<mutex> guard(failureLock);
+                if (!failure) {
+                    failure = current_exception();
+                }
+            }
+        };
+        vector<thread> pool;
+        for (size_t i = 1; i < threads; ++i) {
+            pool.emplace_back(worker);
+        }
+        worker();
+        for (thread &member: pool) {
+            member.join();
+        }
+        if (failure) {
+            rethrow_exception(failure);
+        }
+    }
+
+    void stealingFor(size_t count, size_t threads, size_t grain,
+                     const function<void(size_t worker, size_t begin, size_t end)> &body) {
+        grain = max<size_t>(1, grain);
+        threads = threads != 0 ? threads : max(1U, thread::hardware_concurrency());
+        threads = max<size_t>(1, min(threads, (count + grain - 1) / grain));
+        if (threads == 1) {
+            if (count > 0) {
+                body(0, 0, count);
+            }
+            return;
+        }
+        vector<StealRange> ranges(threads);
+        for (size_t worker = 0; worker < threads; ++worker) {
+            ranges[worker].begin = count * worker / threads;
+            ranges[worker].end = count * (worker + 1) / threads;
+        }
+        parallelFor(threads, threads, [&](size_t worker) {
+            StealRange &own = ranges[worker];
+            for (;;) {
+                size_t begin;
+                size_t end;
+                {
+                    lock_guard<mutex> guard(own.lock);
+                    begin = own.begin;
+                    end = min(own.end, begin + max(grain, (own.end - begin) / 8));
+                    own.begin = end;
+                }
+                if (begin < end) {
+                    body(worker, begin, end);
+                    continue;
+                }
+                // Out of work: take the back half of the first victim with at least two grains left.
+                bool stolen = false;
+                for (size_t offset = 1; offset < threads && !stolen; ++offset) {
+                    StealRange &victim = ranges[(worker + offset) % threads];
+                    lock_guard<mutex> guard(victim.lock);
+                    size_t left = victim.end - victim.begin;
+                    if (left >= 2 * grain) {
+                        begin = victim.end - left / 2;
+                        end = victim.end;
+                        victim.end = begin;
+                        stolen = true;
+                    }
+                }
+                if (!stolen) {
+                    return;
+                }
+                lock_guard<mutex> guard(own.lock);
+                own.begin = begin;
+                own.end = end;
+            }
+        });
+    }
+
+    LoserTree::LoserTree(const vector<span<const int>> &runs) : leaves(bit_ceil(max<size_t>(1, runs.size()))) {
+        // Padding runs are empty, so they lose every match.
+        heads.assign(leaves, nullptr);
+        ends.assign(leaves, nullptr);
+        for (size_t i = 0; i < runs.size(); ++i) {
+            heads[i] = runs[i].data();
+            ends[i] = runs[i].data() + runs[i].size();
+        }
+        // Play the tournament bottom-up: winners[node] moves on, losers[node] stays behind.
+        vector<size_t> winners(2 * leaves);
+        for (size_t i = 0; i < leaves; ++i) {
+            winners[leaves + i] = i;
+        }
+        losers.assign(leaves, 0);
+        for (size_t node = leaves - 1; node >= 1; --node) {
+            size_t left = winners[2 * node];
+            size_t right = winners[2 * node + 1];
+            bool leftWins = beats(left, right);
+            winners[node] = leftWins ? left : right;
+            losers[node] = leftWins ? right : left;
+        }
+        losers[0] = winners[1];
+    }
+
+    bool LoserTree::beats(size_t run, size_t other) const {
+        if (heads[run] == ends[run]) {
+            return false;
+        }
+        if (heads[other] == ends[other]) {
+            return true;
+        }
+        return *heads[run] < *heads[other] || (*heads[run] == *heads[other] && run < other);
+    }
+
+    int LoserTree::pop() {
+        size_t winner = losers[0];
+        int value = *heads[winner]++;
+        for (size_t node = (winner + leaves) / 2; node >= 1; node /= 2) {
+            if (beats(losers[node], winner)) {
+                swap(losers[node], winner);
+            }
+        }
+        losers[0] = winner;
+        return value;
+    }
+
+    vector<int> mergeSortedRuns(const vector<span<const int>> &runs, size_t threads) {
+        threads = max<size_t>(1, threads);
+        vector<int> splitters = threads > 1 ? chooseSplitters(runs, threads) : vector<int>{};
+        size_t parts = splitters.size() + 1;
+
+        vector<vector<int>> slices(parts);
+        parallelFor(parts, threads, [&](size_t part) {
+            vector<span<const int>> pieces;
+            size_t bound = 0;
+            for (span<const int> run: runs) {
+                const int *begin = part == 0 ? run.data() : lowerBound(run, splitters[part - 1]);
+                const int *end = part + 1 == parts ? run.data() + run.size() : lowerBound(run, splitters[part]);
+                pieces.emplace_back(begin, end);
+                bound += pieces.back().size();
+            }
+            vector<int> &slice = slices[part];
+            slice.reserve(bound);
+            LoserTree tree(pieces);
+            while (!tree.empty()) {
+                int value = tree.pop();
+                if (slice.empty() || slice.back() != value) {
+                    slice.push_back(value);
+                }
+            }
+        });
+        if (parts == 1) {
+            return std::move(slices[0]);
+        }
+
+        vector<size_t> offsets(parts + 1, 0);
+        for (size_t part = 0; part < parts; ++part) {
+            offsets[part + 1] = offsets[part] + slices[part].size();
+        }
+        vector<int> merged(offsets[parts]);
+        parallelFor(parts, threads, [&](size_t part) {
+            copy(slices[part].begin(), slices[part].end(), merged.begin() + static_cast<ptrdiff_t>(offsets[part]));
+            vector<int>().swap(slices[part]);
+        });
+        return merged;
+    }
+}
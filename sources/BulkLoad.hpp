@@ -0,0 +1,62 @@
+#ifndef MAGICAL_ITERATORS_BULKLOAD_HPP
+#define MAGICAL_ITERATORS_BULKLOAD_HPP
+
+#include <cstddef>
+#include <functional>
+#include <span>
+#include <vector>
+
+// Building blocks of MagicalContainer's parallel paths: thread fan-out, work stealing, radix
+// sort and a parallel k-way merge.
+namespace ariel {
+
+    // Below this many values per thread, starting a thread costs more than it saves.
+    constexpr size_t BULK_MIN_PER_THREAD = size_t{1} << 16;
+
+    // Threads to use for `count` values: `requested`, or the hardware concurrency when 0,
+    // capped so every thread gets at least BULK_MIN_PER_THREAD values.
+    size_t bulkThreadCount(size_t count, size_t requested);
+
+    // Batches smaller than this are left to std::sort.
+    constexpr size_t RADIX_SORT_MIN = 1024;
+
+    // Sorts in place with an LSD radix sort on 11-bit digits of the sign-flipped key.
+    // Sorted input is detected and left alone, and a pass whose digit is the same for every
+    // value (e.g. the top digit of small non-negative values) is skipped.
+    void radixSort(std::span<int> values);
+
+    // Runs task(0) ... task(tasks - 1) on up to `threads` threads, the calling one included.
+    void parallelFor(size_t tasks, size_t threads, const std::function<void(size_t)> &task);
+
+    // Calls body(worker, begin, end) on disjoint chunks covering [0, count), using up to
+    // `threads` threads (0 = all hardware threads) and never fewer than `grain` items per thread.
+    // Every worker starts with an equal share and carves chunks of an eighth of what it has left
+    // (at least `grain`) off its front; a worker that runs dry steals the back half of another's.
+    void stealingFor(size_t count, size_t threads, size_t grain,
+                     const std::function<void(size_t worker, size_t begin, size_t end)> &body);
+
+    // Tournament tree over k sorted runs: each pop() yields the smallest remaining head in
+    // log2(k) comparisons, replaying only the path of the run it came from.
+    class LoserTree {
+    private:
+        std::vector<const int *> heads;
+        std::vector<const int *> ends;
+        std::vector<size_t> losers;
+        size_t leaves;
+
+        bool beats(size_t run, size_t other) const;
+
+    public:
+        explicit LoserTree(const std::vector<std::span<const int>> &runs);
+
+        // An exhausted run loses to every other, so the winner is exhausted only when all are.
+        bool empty() const { return heads[losers[0]] == ends[losers[0]]; }
+        int pop();
+    };
+
+    // Merges sorted, individually duplicate-free runs into one sorted duplicate-free vector.
+    // The value space is cut at splitters sampled from the runs, and each slice is merged by
+    // its own LoserTree on its own thread before the slices are concatenated.
+    std::vector<int> mergeSortedRuns(const std::vector<std::span<const int>> &runs, size_t threads);
+}
+#endif //MAGICAL_ITERATORS_BULKLOAD_HPP
@@ -0,0 +1,196 @@
+#include "Codec.hpp"
+
+#include <array>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MAGICAL_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+    // Per control byte: total gap bytes, and the pshufb mask spreading them over 4 lanes.
+    struct ControlTables {
+        array<uint8_t, 256> lengths{};
+        array<array<uint8_t, 16>, 256> shuffles{};
+
+        ControlTables() {
+            for (unsigned control = 0; control < 256; ++control) {
+                uint8_t source = 0;
+                for (unsigned lane = 0; lane < 4; ++lane) {
+                    unsigned length = ((control >> (2 * lane)) & 3U) + 1;
+                    for (unsigned byte = 0; byte < 4; ++byte) {
+                        shuffles[control][lane * 4 + byte] = byte < length ? source++ : 0xFF;
+                    }
+                }
+                lengths[control] = source;
+            }
+        }
+    };
+
+    const ControlTables &tables() {
+        static const ControlTables instance;
+        return instance;
+    }
+
+    unsigned byteLength(uint32_t gap) {
+        return gap < (1U << 8) ? 1 : gap < (1U << 16) ? 2 : gap < (1U << 24) ? 3 : 4;
+    }
+
+    size_t decodeScalar(const uint8_t *in, size_t count, int previous, int *out) {
+        const uint8_t *control = in;
+        const uint8_t *data = in + (count + 3) / 4;
+        auto value = static_cast<uint32_t>(previous);
+        for (size_t i = 0; i < count; ++i) {
+            unsigned length = ((control[i / 4] >> (2 * (i % 4))) & 3U) + 1;
+            uint32_t gap = 0;
+            memcpy(&gap, data, length);
+            data += length;
+            value += gap;
+            out[i] = static_cast<int>(value);
+        }
+        return static_cast<size_t>(data - in);
+    }
+
+    uint32_t crcScalar(const uint8_t *data, size_t size, uint32_t crc) {
+        static const array<uint32_t, 256> table = [] {
+            array<uint32_t, 256> result{};
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t entry = i;
+                for (int bit = 0; bit < 8; ++bit) {
+                    entry = (entry >> 1) ^ ((entry & 1U) != 0 ? 0x82F63B78U : 0U);
+                }
+                result[i] = entry;
+            }
+            return result;
+        }();
+        crc = ~crc;
+        for (size_t i = 0; i < size; ++i) {
+            crc = (crc >> 8) ^ table[(crc ^ data[i]) & 0xFFU];
+        }
+        return ~crc;
+    }
+
+#ifdef MAGICAL_X86_DISPATCH
+    // Four gaps per step: pshufb spreads their bytes into lanes, then a log-step prefix sum
+    // adds them onto the running value.
+    __attribute__((target("ssse3")))
+    size_t decodeSsse3(const uint8_t *in, size_t count, int previous, int *out) {
+        const ControlTables &lookup = tables();
+        const uint8_t *control = in;
+        const uint8_t *data = in + (count + 3) / 4;
+        __m128i running = _mm_set1_epi32(previous);
+        size_t groups = count / 4;
+        for (size_t group = 0; group < groups; ++group) {
+            uint8_t code = control[group];
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+            __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i *>(lookup.shuffles[code].data()));
+            __m128i gaps = _mm_shuffle_epi8(bytes, mask);
+            gaps = _mm_add_epi32(gaps, _mm_slli_si128(gaps, 4));
+            gaps = _mm_add_epi32(gaps, _mm_slli_si128(gaps, 8));
+            running = _mm_add_epi32(gaps, _mm_shuffle_epi32(running, _MM_SHUFFLE(3, 3, 3, 3)));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + group * 4), running);
+            data += lookup.lengths[code];
+        }
+        size_t done = groups * 4;
+        if (done == count) {
+            return static_cast<size_t>(data - in);
+        }
+        // The last partial group: decode it on its own, with its control byte first.
+        int last = done == 0 ? previous : out[done - 1];
+        array<uint8_t, 1 + 3 * 4> tail{};
+        tail[0] = control[groups];
+        size_t tailBytes = 0;
+        for (size_t i = 0; i < count - done; ++i) {
+            tailBytes += ((tail[0] >> (2 * i)) & 3U) + 1;
+        }
+        memcpy(tail.data() + 1, data, tailBytes);
+        decodeScalar(tail.data(), count - done, last, out + done);
+        return static_cast<size_t>(data - in) + tailBytes;
+    }
+
+    __attribute__((target("sse4.2")))
+    uint32_t crcSse42(const uint8_t *data, size_t size, uint32_t crc) {
+        uint64_t state = ~crc;
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            uint64_t word;
+            memcpy(&word, data + i, 8);
+            state = _mm_crc32_u64(state, word);
+        }
+        auto narrow = static_cast<uint32_t>(state);
+        for (; i < size; ++i) {
+            narrow = _mm_crc32_u8(narrow, data[i]);
+        }
+        return ~narrow;
+    }
+#endif
+
+    struct Kernels {
+        size_t (*decode)(const uint8_t *, size_t, int, int *);
+        uint32_t (*crc)(const uint8_t *, size_t, uint32_t);
+        const char *target;
+    };
+
+    const Kernels &kernels() {
+        static const Kernels selected = [] {
+#ifdef MAGICAL_X86_DISPATCH
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("ssse3") && __builtin_cpu_supports("sse4.2")) {
+                return Kernels{decodeSsse3, crcSse42, "ssse3+sse4.2"};
+            }
+#endif
+            return Kernels{decodeScalar, crcScalar, "scalar"};
+        }();
+        return selected;
+    }
+}
+
+namespace ariel {
+
+    void encodeDeltas(span<const int> values, int previous, vector<uint8_t> &out) {
+        size_t controlStart = out.size();
+        out.resize(controlStart + (values.size() + 3) / 4, 0);
+        auto last = static_cast<uint32_t>(previous);
+        for (size_t i = 0; i < values.size(); ++i) {
+            uint32_t gap = static_cast<uint32_t>(values[i]) - last;
+            last = static_cast<uint32_t>(values[i]);
+            unsigned length = byteLength(gap);
+            out[controlStart + i / 4] |= static_cast<uint8_t>((length - 1) << (2 * (i % 4)));
+            for (unsigned byte = 0; byte < length; ++byte) {
+                out.push_back(static_cast<uint8_t>(gap >> (8 * byte)));
+            }
+        }
+    }
+
+    size_t encodedDeltaBytes(const uint8_t *in, size_t available, size_t count) {
+        size_t controlBytes = (count + 3) / 4;
+        if (available < controlBytes) {
+            return 0;
+        }
+        const ControlTables &lookup = tables();
+        size_t total = controlBytes;
+        for (size_t group = 0; group < count / 4; ++group) {
+            total += lookup.lengths[in[group]];
+        }
+        for (size_t i = count / 4 * 4; i < count; ++i) {
+            total += ((in[i / 4] >> (2 * (i % 4))) & 3U) + 1;
+        }
+        return total;
+    }
+
+    size_t decodeDeltas(const uint8_t *in, size_t count, int previous, int *out) {
+        return kernels().decode(in, count, previous, out);
+    }
+
+    uint32_t crc32c(const uint8_t *data, size_t size, uint32_t crc) {
+        return kernels().crc(data, size, crc);
+    }
+
+    const char *codecTarget() {
+        return kernels().target;
+    }
+}
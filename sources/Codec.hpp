@@ -0,0 +1,35 @@
+#ifndef MAGICAL_ITERATORS_CODEC_HPP
+#define MAGICAL_ITERATORS_CODEC_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Compression and checksums for MagicalContainer's on-disk format.
+// Decoding and CRCs pick SSSE3 / SSE4.2 code at runtime when the CPU has it.
+namespace ariel {
+
+    // Bytes a decoder may read past the end of an encoding; callers must keep them readable.
+    constexpr size_t DECODE_SLACK = 16;
+
+    // Appends the StreamVByte encoding of the gaps between consecutive ascending values, the
+    // first taken from `previous`: one control byte per 4 gaps (2 bits each: byte length - 1),
+    // then the gap bytes, little-endian.
+    void encodeDeltas(std::span<const int> values, int previous, std::vector<uint8_t> &out);
+
+    // Bytes encodeDeltas produced for `count` values, read from the control bytes alone;
+    // 0 if fewer than the control bytes are available.
+    size_t encodedDeltaBytes(const uint8_t *in, size_t available, size_t count);
+
+    // Decodes `count` values into `out` and returns the bytes consumed. The caller must have
+    // checked the length with encodedDeltaBytes.
+    size_t decodeDeltas(const uint8_t *in, size_t count, int previous, int *out);
+
+    // CRC-32C (Castagnoli), continuing from `crc`.
+    uint32_t crc32c(const uint8_t *data, size_t size, uint32_t crc = 0);
+
+    // "ssse3+sse4.2" or "scalar": the kernels selected on this machine.
+    const char *codecTarget();
+}
+#endif //MAGICAL_ITERATORS_CODEC_HPP
@@ -0,0 +1,231 @@
+#include "DurableMagicalContainer.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <stdexcept>
+#include <unistd.h>
+#include <unordered_map>
+
+using namespace ariel;
+
+namespace {
+    constexpr const char *SEGMENT_PREFIX = "wal-";
+    constexpr const char *SEGMENT_SUFFIX = ".log";
+    constexpr const char *CHECKPOINT_PREFIX = "checkpoint-";
+    constexpr const char *CHECKPOINT_SUFFIX = ".bin";
+    constexpr const char *CHECKPOINT_TEMP = "checkpoint.tmp";
+
+    [[noreturn]] void systemError(const string &what) {
+        throw runtime_error(what + ": " + strerror(errno));
+    }
+}
+
+DurableMagicalContainer::DurableMagicalContainer(const string &directory, Options options)
+        : directory(directory), options(options) {
+    filesystem::create_directories(directory);
+    filesystem::remove(filesystem::path(directory) / CHECKPOINT_TEMP);
+
+    vector<uint64_t> checkpoints = numberedFiles(CHECKPOINT_PREFIX, CHECKPOINT_SUFFIX);
+    if (!checkpoints.empty()) {
+        checkpointed = checkpoints.back();
+        string path = numberedPath(CHECKPOINT_PREFIX, checkpointed, CHECKPOINT_SUFFIX);
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            systemError("open(" + path + ")");
+        }
+        try {
+            container = MagicalContainer::load(fd);
+        } catch (...) {
+            close(fd);
+            throw;
+        }
+        close(fd);
+        removeObsolete(checkpointed);
+    }
+
+    // Only the last operation on a value matters, whatever the checkpoint held before it.
+    unordered_map<int, LogOp> last;
+    segment = checkpointed + 1;
+    for (uint64_t number: numberedFiles(SEGMENT_PREFIX, SEGMENT_SUFFIX)) {
+        if (number <= checkpointed) {
+            continue;
+        }
+        segment = number;
+        replayed += WriteAheadLog::read(numberedPath(SEGMENT_PREFIX, number, SEGMENT_SUFFIX),
+                                        [&last](const vector<LogRecord> &frame) {
+            for (const LogRecord &record: frame) {
+                last[record.value] = record.op;
+            }
+        });
+    }
+    vector<int> added;
+    vector<int> removed;
+    for (const auto &[value, op]: last) {
+        (op == LogOp::ADD ? added : removed).push_back(value);
+    }
+    container.addElements(added);
+    container.removeElements(removed);
+    sinceCheckpoint = replayed;
+
+    log = make_unique<WriteAheadLog>(numberedPath(SEGMENT_PREFIX, segment, SEGMENT_SUFFIX), options.log);
+}
+
+DurableMagicalContainer::~DurableMagicalContainer() {
+    if (checkpointer.joinable()) {
+        checkpointer.join();
+    }
+}
+
+vector<uint64_t> DurableMagicalContainer::numberedFiles(const string &prefix, const string &suffix) const {
+    vector<uint64_t> numbers;
+    for (const filesystem::directory_entry &entry: filesystem::directory_iterator(directory)) {
+        string name = entry.path().filename().string();
+        if (name.size() > prefix.size() + suffix.size() && name.starts_with(prefix) && name.ends_with(suffix) &&
+            all_of(name.begin() + static_cast<ptrdiff_t>(prefix.size()),
+                   name.end() - static_cast<ptrdiff_t>(suffix.size()), [](char c) { return c >= '0' && c <= '9'; })) {
+            numbers.push_back(stoull(name.substr(prefix.size(), name.size() - prefix.size() - suffix.size())));
+        }
+    }
+    sort(numbers.begin(), numbers.end());
+    return numbers;
+}
+
+string DurableMagicalContainer::numberedPath(const string &prefix, uint64_t number, const string &suffix) const {
+    char digits[24];
+    snprintf(digits, sizeof(digits), "%06llu", static_cast<unsigned long long>(number));
+    return (filesystem::path(directory) / (prefix + digits + suffix)).string();
+}
+
+void DurableMagicalContainer::logged(size_t records) {
+    sinceCheckpoint += records;
+    if (checkpointer.joinable() && !checkpointRunning.load(memory_order_acquire)) {
+        reapCheckpoint();
+    }
+    if (options.checkpointRecords > 0 && sinceCheckpoint >= options.checkpointRecords && !checkpointer.joinable()) {
+        // The mutation has committed by now, so a failure here must not be reported as its
+        // own. It is kept for the next explicit checkpoint() or waitForCheckpoint().
+        try {
+            startCheckpoint();
+        } catch (...) {
+            checkpointImage = MagicalContainer();
+            if (!checkpointFailure) {
+                checkpointFailure = current_exception();
+            }
+        }
+    }
+}
+
+void DurableMagicalContainer::addElement(int element) {
+    log->append(LogOp::ADD, element);
+    container.addElement(element);
+    logged(1);
+}
+
+void DurableMagicalContainer::removeElement(int element) {
+    const vector<int> &elements = container.getElements();
+    if (!binary_search(elements.begin(), elements.end(), element)) {
+        // Throws the usual error before anything is logged or changed.
+        container.removeElement(element);
+    }
+    log->append(LogOp::REMOVE, element);
+    container.removeElement(element);
+    logged(1);
+}
+
+void DurableMagicalContainer::addElements(span<const int> values, size_t threads) {
+    log->append(LogOp::ADD, values);
+    container.addElements(values, threads);
+    logged(values.size());
+}
+
+void DurableMagicalContainer::removeElements(span<const int> values) {
+    log->append(LogOp::REMOVE, values);
+    container.removeElements(values);
+    logged(values.size());
+}
+
+void DurableMagicalContainer::sync() {
+    log->sync();
+}
+
+void DurableMagicalContainer::checkpoint() {
+    waitForCheckpoint();
+    startCheckpoint();
+}
+
+void DurableMagicalContainer::startCheckpoint() {
+    // No mutation runs between the snapshot and the rotation, so the snapshot holds exactly
+    // the records of the segments up to `covered`.
+    checkpointImage = container.snapshot();
+    uint64_t covered = segment;
+    log->rotate(numberedPath(SEGMENT_PREFIX, covered + 1, SEGMENT_SUFFIX));
+    segment = covered + 1;
+    checkpointed = covered;
+    sinceCheckpoint = 0;
+    checkpointRunning.store(true, memory_order_relaxed);
+    checkpointer = thread([this, covered] {
+        try {
+            writeCheckpoint(covered);
+        } catch (...) {
+            if (!checkpointFailure) {
+                checkpointFailure = current_exception();
+            }
+        }
+        checkpointRunning.store(false, memory_order_release);
+    });
+}
+
+void DurableMagicalContainer::reapCheckpoint() {
+    if (checkpointer.joinable()) {
+        checkpointer.join();
+    }
+    // Drop the writer's share of the storage, so later mutations stop copying it.
+    checkpointImage = MagicalContainer();
+}
+
+void DurableMagicalContainer::waitForCheckpoint() {
+    reapCheckpoint();
+    if (checkpointFailure) {
+        exception_ptr failure = checkpointFailure;
+        checkpointFailure = nullptr;
+        rethrow_exception(failure);
+    }
+}
+
+void DurableMagicalContainer::writeCheckpoint(uint64_t covered) {
+    string temp = (filesystem::path(directory) / CHECKPOINT_TEMP).string();
+    int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        systemError("open(" + temp + ")");
+    }
+    try {
+        checkpointImage.save(fd);
+        if (fdatasync(fd) != 0) {
+            systemError("fdatasync(" + temp + ")");
+        }
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+    filesystem::rename(temp, numberedPath(CHECKPOINT_PREFIX, covered, CHECKPOINT_SUFFIX));
+    syncDirectory(directory);
+    removeObsolete(covered);
+}
+
+void DurableMagicalContainer::removeObsolete(uint64_t covered) const {
+    for (uint64_t number: numberedFiles(SEGMENT_PREFIX, SEGMENT_SUFFIX)) {
+        if (number <= covered) {
+            filesystem::remove(numberedPath(SEGMENT_PREFIX, number, SEGMENT_SUFFIX));
+        }
+    }
+    for (uint64_t number: numberedFiles(CHECKPOINT_PREFIX, CHECKPOINT_SUFFIX)) {
+        if (number < covered) {
+            filesystem::remove(numberedPath(CHECKPOINT_PREFIX, number, CHECKPOINT_SUFFIX));
+        }
+    }
+}
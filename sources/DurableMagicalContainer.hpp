@@ -0,0 +1,102 @@
+#ifndef MAGICAL_ITERATORS_DURABLEMAGICALCONTAINER_HPP
+#define MAGICAL_ITERATORS_DURABLEMAGICALCONTAINER_HPP
+
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+#include "MagicalContainer.hpp"
+#include "WriteAheadLog.hpp"
+
+using namespace std;
+namespace ariel {
+
+    // A MagicalContainer whose mutations are recorded in a write-ahead log kept in `directory`,
+    // as segments named wal-<number>.log, next to checkpoints named checkpoint-<number>.bin.
+    //
+    // Each mutation is appended to the log before it is applied. append() only buffers, and it
+    // throws if an earlier flush failed, so a failed log leaves the container unchanged. A
+    // removeElement of an absent value throws before it is logged. The log commits in groups (see
+    // WriteAheadLog): a mutation is durable once sync() returns, or within about one latency
+    // budget after it was made.
+    //
+    // checkpoint() takes an O(1) snapshot, moves the log on to a new segment, and lets a
+    // background thread save() the snapshot while mutations continue. checkpoint-N holds
+    // everything in segments 1..N, so once it is on disk those segments are deleted. The first
+    // mutation of each storage vector after a checkpoint copies all of it (see
+    // MagicalContainer::snapshot), because the writer still shares it. Checkpoints also start on
+    // their own every `checkpointRecords` records, so reopening loads one checkpoint and replays
+    // at most about that many records.
+    //
+    // Opening the directory loads the newest checkpoint and replays the segments after it.
+    // The last operation on each value decides whether it is present, and the net result goes
+    // through addElements and removeElements in one pass each. Not thread-safe, like
+    // MagicalContainer.
+    class DurableMagicalContainer {
+    public:
+        struct Options {
+            WriteAheadLog::Options log;
+            // Records logged since the last checkpoint that start the next one; 0 disables them.
+            size_t checkpointRecords = size_t{1} << 22;
+        };
+
+    private:
+        string directory;
+        Options options;
+        MagicalContainer container;
+        unique_ptr<WriteAheadLog> log;
+        size_t replayed = 0;
+        // Segment being appended to, and the last one covered by the newest checkpoint.
+        uint64_t segment = 1;
+        uint64_t checkpointed = 0;
+        size_t sinceCheckpoint = 0;
+
+        // Snapshot being written by the checkpointer; released once it is joined.
+        MagicalContainer checkpointImage;
+        thread checkpointer;
+        atomic<bool> checkpointRunning{false};
+        exception_ptr checkpointFailure;
+
+        vector<uint64_t> numberedFiles(const string &prefix, const string &suffix) const;
+        string numberedPath(const string &prefix, uint64_t number, const string &suffix) const;
+        void logged(size_t records);
+        void startCheckpoint();
+        void reapCheckpoint();
+        void writeCheckpoint(uint64_t covered);
+        void removeObsolete(uint64_t covered) const;
+
+    public:
+        DurableMagicalContainer(const string &directory, Options options);
+        explicit DurableMagicalContainer(const string &directory) : DurableMagicalContainer(directory, Options()) {}
+        DurableMagicalContainer(const DurableMagicalContainer &) = delete;
+        DurableMagicalContainer &operator=(const DurableMagicalContainer &) = delete;
+        // Waits for a running checkpoint, then makes every mutation durable.
+        ~DurableMagicalContainer();
+
+        void addElement(int element);
+        void removeElement(int element);
+        void addElements(span<const int> values, size_t threads = 0);
+        void removeElements(span<const int> values);
+        // Blocks until every mutation made so far is on disk.
+        void sync();
+
+        // Starts a background checkpoint of the current contents, first waiting for the previous one.
+        void checkpoint();
+        // Waits for the running checkpoint, if any. Rethrows the first error of a checkpoint that
+        // failed since the last call, including automatic ones: those never fail the mutation
+        // that started them.
+        void waitForCheckpoint();
+
+        const MagicalContainer &get() const { return container; }
+        size_t size() const { return container.size(); }
+        // Records replayed from the log when the directory was opened.
+        size_t replayedRecords() const { return replayed; }
+        // Number of the newest checkpoint started, 0 if none.
+        uint64_t checkpointSegment() const { return checkpointed; }
+        const WriteAheadLog &getLog() const { return *log; }
+    };
+}
+#endif //MAGICAL_ITERATORS_DURABLEMAGICALCONTAINER_HPP
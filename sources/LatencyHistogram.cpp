@@ -0,0 +1,178 @@
+#include "LatencyHistogram.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace ariel;
+using namespace std;
+
+size_t LatencyHistogram::bucketOf(uint64_t value) {
+    if (value < SUB_BUCKETS) {
+        return static_cast<size_t>(value);
+    }
+    // The top SUB_BUCKET_BITS + 1 bits of the value select the bucket.
+    auto shift = static_cast<unsigned>(bit_width(value)) - SUB_BUCKET_BITS - 1;
+    uint64_t top = value >> shift;
+    return static_cast<size_t>((shift + 1) * SUB_BUCKETS + (top - SUB_BUCKETS));
+}
+
+uint64_t LatencyHistogram::highestInBucket(size_t bucket) {
+    if (bucket < SUB_BUCKETS) {
+        return bucket;
+    }
+    uint64_t shift = bucket / SUB_BUCKETS - 1;
+    uint64_t top = SUB_BUCKETS + bucket % SUB_BUCKETS;
+    return ((top + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t nanos) {
+    ++counts[bucketOf(nanos)];
+    ++total;
+    sum += static_cast<long double>(nanos);
+    minValue = std::min(minValue, nanos);
+    maxValue = std::max(maxValue, nanos);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other) {
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        counts[i] += other.counts[i];
+    }
+    total += other.total;
+    sum += other.sum;
+    minValue = std::min(minValue, other.minValue);
+    maxValue = std::max(maxValue, other.maxValue);
+}
+
+void LatencyHistogram::reset() {
+    *this = LatencyHistogram();
+}
+
+double LatencyHistogram::mean() const {
+    return total == 0 ? 0.0 : static_cast<double>(sum / static_cast<long double>(total));
+}
+
+uint64_t LatencyHistogram::percentile(double percent) const {
+    if (total == 0) {
+        return 0;
+    }
+    percent = std::min(100.0, std::max(0.0, percent));
+    auto rank = static_cast<uint64_t>(percent / 100.0 * static_cast<double>(total) + 0.5);
+    rank = std::max<uint64_t>(rank, 1);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return std::min(highestInBucket(i), maxValue);
+        }
+    }
+    return maxValue;
+}
+
+string LatencyHistogram::toJson() const {
+    return "{\"count\": " + to_string(total) +
+           ", \"min\": " + to_string(min()) +
+           ", \"mean\": " + to_string(mean()) +
+           ", \"p50\": " + to_string(percentile(50)) +
+           ", \"p90\": " + to_string(percentile(90)) +
+           ", \"p99\": " + to_string(percentile(99)) +
+           ", \"p999\": " + to_string(percentile(99.9)) +
+           ", \"max\": " + to_string(max()) + "}";
+}
+
+namespace {
+    constexpr size_t OP_COUNT = 3;
+
+    // One per recording thread; the mutex is only ever contended by snapshot()/reset().
+    struct Shard {
+        mutex lock;
+        array<LatencyHistogram, OP_COUNT> histograms;
+    };
+
+    // Shards of the live threads, plus what exited threads recorded, folded together so that
+    // short-lived threads do not grow the registry.
+    struct Registry {
+        mutex lock;
+        vector<Shard *> shards;
+        array<LatencyHistogram, OP_COUNT> retired;
+    };
+
+    Registry &registry() {
+        static Registry instance;
+        return instance;
+    }
+
+    // Registers the thread's shard on first use, and retires it when the thread exits.
+    struct LocalShard {
+        Shard shard;
+
+        LocalShard() {
+            Registry &reg = registry();
+            lock_guard<mutex> guard(reg.lock);
+            reg.shards.push_back(&shard);
+        }
+
+        ~LocalShard() {
+            Registry &reg = registry();
+            lock_guard<mutex> guard(reg.lock);
+            lock_guard<mutex> shardGuard(shard.lock);
+            for (size_t op = 0; op < OP_COUNT; ++op) {
+                reg.retired[op].merge(shard.histograms[op]);
+            }
+            reg.shards.erase(find(reg.shards.begin(), reg.shards.end(), &shard));
+        }
+    };
+
+    Shard &localShard() {
+        thread_local LocalShard local;
+        return local.shard;
+    }
+}
+
+atomic<uint32_t> LatencyRecorder::samplingPeriod{0};
+thread_local uint32_t LatencyRecorder::countdown = 0;
+
+void LatencyRecorder::setSampling(uint32_t everyN) {
+    samplingPeriod.store(everyN, memory_order_relaxed);
+    countdown = 0;
+}
+
+void LatencyRecorder::record(LatencyOp op, uint64_t nanos) {
+    Shard &shard = localShard();
+    lock_guard<mutex> guard(shard.lock);
+    shard.histograms[static_cast<size_t>(op)].record(nanos);
+}
+
+LatencyHistogram LatencyRecorder::snapshot(LatencyOp op) {
+    LatencyHistogram merged;
+    Registry &reg = registry();
+    lock_guard<mutex> guard(reg.lock);
+    merged.merge(reg.retired[static_cast<size_t>(op)]);
+    for (Shard *shard: reg.shards) {
+        lock_guard<mutex> shardGuard(shard->lock);
+        merged.merge(shard->histograms[static_cast<size_t>(op)]);
+    }
+    return merged;
+}
+
+size_t LatencyRecorder::recordingThreads() {
+    Registry &reg = registry();
+    lock_guard<mutex> guard(reg.lock);
+    return reg.shards.size();
+}
+
+void LatencyRecorder::reset() {
+    Registry &reg = registry();
+    lock_guard<mutex> guard(reg.lock);
+    for (auto &histogram: reg.retired) {
+        histogram.reset();
+    }
+    for (Shard *shard: reg.shards) {
+        lock_guard<mutex> shardGuard(shard->lock);
+        for (auto &histogram: shard->histograms) {
+            histogram.reset();
+        }
+    }
+}
@@ -0,0 +1,114 @@
+#ifndef MAGICAL_ITERATORS_LATENCYHISTOGRAM_HPP
+#define MAGICAL_ITERATORS_LATENCYHISTOGRAM_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace ariel {
+
+    // Log-linear (HDR style) histogram of latencies in nanoseconds.
+    // Values below 2^SUB_BUCKET_BITS are exact; every higher power of two is split into
+    // 2^SUB_BUCKET_BITS linear buckets, so any recorded value is off by at most ~3%.
+    class LatencyHistogram {
+    public:
+        static constexpr unsigned SUB_BUCKET_BITS = 5;
+        static constexpr uint64_t SUB_BUCKETS = uint64_t{1} << SUB_BUCKET_BITS;
+        static constexpr size_t BUCKETS = (65 - SUB_BUCKET_BITS) * SUB_BUCKETS;
+
+    private:
+        std::array<uint64_t, BUCKETS> counts{};
+        uint64_t total = 0;
+        uint64_t minValue = UINT64_MAX;
+        uint64_t maxValue = 0;
+        long double sum = 0;
+
+        static size_t bucketOf(uint64_t value);
+        static uint64_t highestInBucket(size_t bucket);
+
+    public:
+        void record(uint64_t nanos);
+        void merge(const LatencyHistogram &other);
+        void reset();
+
+        uint64_t count() const { return total; }
+        uint64_t min() const { return total == 0 ? 0 : minValue; }
+        uint64_t max() const { return maxValue; }
+        double mean() const;
+        // Smallest recorded latency that at least `percent`% of the samples do not exceed.
+        uint64_t percentile(double percent) const;
+
+        std::string toJson() const;
+    };
+
+    enum class LatencyOp { ADD, REMOVE, ITERATE };
+
+    // Process-wide latency recording for MagicalContainer operations.
+    // Each thread records into its own histograms; snapshot() merges them. Recording is off
+    // until setSampling(n) is called, after which one operation in n per thread is timed.
+    // Other threads pick up a new period once their current countdown runs out.
+    class LatencyRecorder {
+    private:
+        static std::atomic<uint32_t> samplingPeriod;
+        static thread_local uint32_t countdown;
+
+    public:
+        static void setSampling(uint32_t everyN);
+        static uint32_t getSampling() { return samplingPeriod.load(std::memory_order_relaxed); }
+
+        static bool shouldSample() {
+            // Between samples only the thread's countdown is touched.
+            if (countdown > 1) {
+                --countdown;
+                return false;
+            }
+            uint32_t period = samplingPeriod.load(std::memory_order_relaxed);
+            if (period == 0) {
+                return false;
+            }
+            // A countdown of 0 means this thread has not started one yet.
+            if (countdown == 0 && period > 1) {
+                countdown = period - 1;
+                return false;
+            }
+            countdown = period;
+            return true;
+        }
+
+        static void record(LatencyOp op, uint64_t nanos);
+        // Includes what threads that have since exited recorded.
+        static LatencyHistogram snapshot(LatencyOp op);
+        static void reset();
+        // Live threads holding histograms; an exiting thread folds its own into a shared total.
+        static size_t recordingThreads();
+    };
+
+    // Times the enclosing scope into the recorder when this operation is sampled.
+    class LatencyScope {
+    private:
+        using Clock = std::chrono::steady_clock;
+        LatencyOp op;
+        bool sampled;
+        Clock::time_point start;
+
+    public:
+        explicit LatencyScope(LatencyOp op) : op(op), sampled(LatencyRecorder::shouldSample()) {
+            if (sampled) {
+                start = Clock::now();
+            }
+        }
+        ~LatencyScope() {
+            if (sampled) {
+                auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start);
+                LatencyRecorder::record(op, static_cast<uint64_t>(elapsed.count()));
+            }
+        }
+        LatencyScope(const LatencyScope &) = delete;
+        LatencyScope(LatencyScope &&) = delete;
+        LatencyScope &operator=(const LatencyScope &) = delete;
+        LatencyScope &operator=(LatencyScope &&) = delete;
+    };
+}
+#endif //MAGICAL_ITERATORS_LATENCYHISTOGRAM_HPP
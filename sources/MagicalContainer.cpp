@@ -1,44 +1,703 @@
 
 #include "MagicalContainer.hpp"
+#include "BulkLoad.hpp"
+#include "Codec.hpp"
+
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace ariel;
+
+namespace {
+    // On-disk format, version 1. All integers are little-endian.
+    //   file header (32 bytes): "MGCL", u16 version, u16 reserved, u32 values per block,
+    //                           u64 element count, u64 prime count, u32 CRC-32C of the bytes before it
+    //   per block (16 bytes):   u32 count, i32 base, u32 payload bytes, u32 CRC-32C of the payload
+    //   block payload:          StreamVByte gaps from base (see Codec.hpp), then a bitmap with
+    //                           bit i set when the block's i-th value is prime
+    // Filter indexes and prefix sums are not stored; they are rebuilt on demand.
+    static_assert(endian::native == endian::little, "the container file format is written in host byte order");
+    constexpr char FILE_MAGIC[4] = {'M', 'G', 'C', 'L'};
+    constexpr uint16_t FILE_VERSION = 1;
+    constexpr uint32_t BLOCK_VALUES = 65536;
+    constexpr size_t FILE_HEADER_BYTES = 32;
+    constexpr size_t BLOCK_HEADER_BYTES = 16;
+
+    template <typename T>
+    void put(uint8_t *out, size_t offset, T value) {
+        memcpy(out + offset, &value, sizeof(T));
+    }
+
+    template <typename T>
+    T get(const uint8_t *in, size_t offset) {
+        T value;
+        memcpy(&value, in + offset, sizeof(T));
+        return value;
+    }
+
+    [[noreturn]] void corrupt(const string &reason) {
+        throw runtime_error("Corrupt container file: " + reason);
+    }
+
+    void writeAll(int fd, const uint8_t *data, size_t size) {
+        while (size > 0) {
+            ssize_t written = write(fd, data, size);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                throw runtime_error(string("save(): ") + strerror(errno));
+            }
+            data += written;
+            size -= static_cast<size_t>(written);
+        }
+    }
+
+    void readAll(int fd, uint8_t *data, size_t size) {
+        while (size > 0) {
+            ssize_t got = read(fd, data, size);
+            if (got < 0 && errno == EINTR) {
+                continue;
+            }
+            if (got < 0) {
+                throw runtime_error(string("load(): ") + strerror(errno));
+            }
+            if (got == 0) {
+                corrupt("truncated");
+            }
+            data += got;
+            size -= static_cast<size_t>(got);
+        }
+    }
+}
 // Default constructor
-MagicalContainer::MagicalContainer() : vecElements(), vecPrime() {}
+MagicalContainer::MagicalContainer()
+        : vecElements(make_shared<vector<int>>()), vecPrime(make_shared<vector<int>>()), storageVersion(nextVersion()) {}
+
+MagicalContainer::MagicalContainer(vector<int> elements, vector<int> primes)
+        : vecElements(make_shared<vector<int>>(std::move(elements))), vecPrime(make_shared<vector<int>>(std::move(primes))),
+          storageVersion(nextVersion()) {}
+
+uint64_t MagicalContainer::nextVersion() {
+    static atomic<uint64_t> counter{1};
+    return counter.fetch_add(1, memory_order_relaxed);
+}
+
+// Gives write access to a vector, copying it first if a snapshot still shares it.
+template <typename T>
+vector<T> &MagicalContainer::detach(shared_ptr<vector<T>> &vec) {
+    if (vec.use_count() > 1) {
+        // Keep the spare capacity, so the insert that follows does not copy a second time.
+        auto copy = make_shared<vector<T>>();
+        copy->reserve(max(vec->capacity(), vec->size() + 1));
+        copy->assign(vec->begin(), vec->end());
+        vec = copy;
+    }
+    return *vec;
+}
+
+void MagicalContainer::insertAt(shared_ptr<vector<int>> &vec, ptrdiff_t pos, int element) {
+    vector<int> &target = detach(vec);
+    storageVersion = nextVersion();
+#ifdef MAGICAL_STATS
+    size_t capacity = target.capacity();
+    MAGICAL_STAT_ADD(counters, elementsShifted, target.size() - static_cast<size_t>(pos));
+#endif
+    target.insert(target.begin() + pos, element);
+#ifdef MAGICAL_STATS
+    if (target.capacity() != capacity) {
+        MAGICAL_STAT_ADD(counters, reallocations, 1);
+    }
+#endif
+}
+
+void MagicalContainer::eraseAt(shared_ptr<vector<int>> &vec, ptrdiff_t pos) {
+    vector<int> &target = detach(vec);
+    storageVersion = nextVersion();
+    MAGICAL_STAT_ADD(counters, elementsShifted, target.size() - static_cast<size_t>(pos) - 1);
+    target.erase(target.begin() + pos);
+}
+
+ptrdiff_t MagicalContainer::insertSorted(shared_ptr<vector<int>> &vec, int element) {
+    auto it = lower_bound(vec->begin(), vec->end(), element);
+    if (it == vec->end() || *it != element) {
+        ptrdiff_t pos = it - vec->begin();
+        insertAt(vec, pos, element);
+        return pos;
+    }
+    return -1;
+}
+
+ptrdiff_t MagicalContainer::eraseSorted(shared_ptr<vector<int>> &vec, int element) {
+    auto it = lower_bound(vec->begin(), vec->end(), element);
+    if (it != vec->end() && *it == element) {
+        ptrdiff_t pos = it - vec->begin();
+        eraseAt(vec, pos);
+        return pos;
+    }
+    return -1;
+}
+
+// A value inserted at pos adds itself to every prefix after it.
+void MagicalContainer::prefixInsert(shared_ptr<vector<long long>> &prefix, ptrdiff_t pos, int element) {
+    vector<long long> &sums = detach(prefix);
+    sums.insert(sums.begin() + pos + 1, sums[static_cast<size_t>(pos)]);
+    for (auto it = sums.begin() + pos + 1; it != sums.end(); ++it) {
+        *it += element;
+    }
+}
+
+void MagicalContainer::prefixErase(shared_ptr<vector<long long>> &prefix, ptrdiff_t pos, int element) {
+    vector<long long> &sums = detach(prefix);
+    sums.erase(sums.begin() + pos + 1);
+    for (auto it = sums.begin() + pos + 1; it != sums.end(); ++it) {
+        *it -= element;
+    }
+}
+
+shared_ptr<vector<long long>> MagicalContainer::buildPrefix(const vector<int> &values) {
+    auto prefix = make_shared<vector<long long>>(values.size() + 1, 0);
+    for (size_t i = 0; i < values.size(); ++i) {
+        (*prefix)[i + 1] = (*prefix)[i] + values[i];
+    }
+    return prefix;
+}
 
 void MagicalContainer::addElement(int element) {
+    LatencyScope latency(LatencyOp::ADD);
     if (isPrime(element)) {
-        auto it = lower_bound(vecPrime.begin(), vecPrime.end(), element);
-        if (it == vecPrime.end() || *it != element) {
-            vecPrime.insert(it, element);
+        ptrdiff_t pos = insertSorted(vecPrime, element);
+        if (pos >= 0 && prefixPrimes) {
+            prefixInsert(prefixPrimes, pos, element);
         }
     }
-    auto it = lower_bound(vecElements.begin(), vecElements.end(), element);
-    if (it == vecElements.end() || *it != element) {
-        vecElements.insert(it, element);
+    ptrdiff_t pos = insertSorted(vecElements, element);
+    if (pos >= 0) {
+        if (prefixElements) {
+            prefixInsert(prefixElements, pos, element);
+        }
+        for (FilterIndex &index: filterIndexes) {
+            if (index.matches(element)) {
+                insertSorted(index.values, element);
+            }
+        }
     }
 }
 
 void MagicalContainer::removeElement(int element) {
+    LatencyScope latency(LatencyOp::REMOVE);
     if (isPrime(element)) {
-        auto it = lower_bound(vecPrime.begin(), vecPrime.end(), element);
-        if (it != vecPrime.end() && *it == element) {
-            vecPrime.erase(it);
+        ptrdiff_t pos = eraseSorted(vecPrime, element);
+        if (pos >= 0 && prefixPrimes) {
+            prefixErase(prefixPrimes, pos, element);
         }
     }
 
-    auto it = std::lower_bound(vecElements.begin(), vecElements.end(), element);
-    if (it != vecElements.end() && *it == element) {
-        vecElements.erase(it);
+    ptrdiff_t pos = eraseSorted(vecElements, element);
+    if (pos >= 0) {
+        if (prefixElements) {
+            prefixErase(prefixElements, pos, element);
+        }
+        for (FilterIndex &index: filterIndexes) {
+            if (index.matches(element)) {
+                eraseSorted(index.values, element);
+            }
+        }
         return;
     }
     throw std::runtime_error("No element!!!");
 }
 
+size_t MagicalContainer::subsetSize(Subset subset) const {
+    switch (subset) {
+        case Subset::PRIMES:
+            return vecPrime->size();
+        case Subset::NON_PRIMES:
+            return vecElements->size() - vecPrime->size();
+        default:
+            return vecElements->size();
+    }
+}
+
+int MagicalContainer::subsetAt(Subset subset, size_t k) const {
+    const vector<int> &elements = *vecElements;
+    const vector<int> &primes = *vecPrime;
+    if (subset == Subset::PRIMES) {
+        return primes[k];
+    }
+    if (subset == Subset::ALL) {
+        return elements[k];
+    }
+    // Every prime after the target sits past elements[k + j], every one before it does not,
+    // so the smallest j with primes[j] > elements[k + j] is the number of primes before it.
+    size_t low = 0;
+    size_t high = primes.size();
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (k + mid >= elements.size() || primes[mid] > elements[k + mid]) {
+            high = mid;
+        } else {
+            low = mid + 1;
+        }
+    }
+    return elements[k + low];
+}
+
+shared_ptr<vector<int>> MagicalContainer::sequenceOf(IteratorType type) const {
+    switch (type) {
+        case IteratorType::ASCENDING:
+        case IteratorType::SIDE_CROSS:
+            return vecElements;
+        case IteratorType::PRIME:
+            return vecPrime;
+        default:
+            throw runtime_error("Parallel traversal supports ASCENDING, PRIME and SIDE_CROSS");
+    }
+}
+
+void MagicalContainer::addElements(span<const int> values, size_t threads) {
+    threads = bulkThreadCount(values.size(), threads);
+    vector<vector<int>> chunks(threads);
+    vector<vector<int>> chunkPrimes(threads);
+    // chunkMatches[index][chunk]: the chunk's values that the index's predicate accepts.
+    vector<vector<vector<int>>> chunkMatches(filterIndexes.size(), vector<vector<int>>(threads));
+    parallelFor(threads, threads, [&](size_t chunk) {
+        size_t first = values.size() * chunk / threads;
+        size_t last = values.size() * (chunk + 1) / threads;
+        vector<int> &sorted = chunks[chunk];
+        sorted.assign(values.begin() + static_cast<ptrdiff_t>(first), values.begin() + static_cast<ptrdiff_t>(last));
+        radixSort(sorted);
+        sorted.erase(unique(sorted.begin(), sorted.end()), sorted.end());
+        copy_if(sorted.begin(), sorted.end(), back_inserter(chunkPrimes[chunk]),
+                [this](int value) { return isPrime(value); });
+        for (size_t index = 0; index < filterIndexes.size(); ++index) {
+            filterIndexes[index].select(sorted, chunkMatches[index][chunk]);
+        }
+    });
+
+    // The current contents are one more run; values already present are deduplicated by the merge.
+    vector<span<const int>> runs = {*vecElements};
+    vector<span<const int>> primeRuns = {*vecPrime};
+    for (size_t chunk = 0; chunk < threads; ++chunk) {
+        runs.emplace_back(chunks[chunk]);
+        primeRuns.emplace_back(chunkPrimes[chunk]);
+    }
+    auto merged = make_shared<vector<int>>(mergeSortedRuns(runs, threads));
+    auto mergedPrimes = make_shared<vector<int>>(mergeSortedRuns(primeRuns, threads));
+    vecElements = merged;
+    vecPrime = mergedPrimes;
+    storageVersion = nextVersion();
+
+    // Filter indexes take their matches the same way vecPrime does.
+    for (size_t index = 0; index < filterIndexes.size(); ++index) {
+        vector<span<const int>> indexRuns = {*filterIndexes[index].values};
+        for (const vector<int> &matches: chunkMatches[index]) {
+            indexRuns.emplace_back(matches);
+        }
+        filterIndexes[index].values = make_shared<vector<int>>(mergeSortedRuns(indexRuns, threads));
+    }
+    if (prefixElements) {
+        prefixElements = buildPrefix(*vecElements);
+        prefixPrimes = buildPrefix(*vecPrime);
+    }
+}
+
+void MagicalContainer::removeElements(span<const int> values) {
+    vector<int> removed(values.begin(), values.end());
+    radixSort(removed);
+    removed.erase(unique(removed.begin(), removed.end()), removed.end());
+    vecElements = make_shared<vector<int>>(differenceSorted(*vecElements, removed));
+    vecPrime = make_shared<vector<int>>(differenceSorted(*vecPrime, removed));
+    storageVersion = nextVersion();
+    for (FilterIndex &index: filterIndexes) {
+        index.values = make_shared<vector<int>>(differenceSorted(*index.values, removed));
+    }
+    if (prefixElements) {
+        prefixElements = buildPrefix(*vecElements);
+        prefixPrimes = buildPrefix(*vecPrime);
+    }
+}
+
 size_t MagicalContainer::size() const {
-    return vecElements.size();
+    return vecElements->size();
+}
+
+// Index range of the values in [low, high); empty (at low's position) when high <= low.
+pair<size_t, size_t> MagicalContainer::positionsOf(const vector<int> &values, int low, int high) {
+    auto first = lower_bound(values.begin(), values.end(), low);
+    auto last = high <= low ? first : lower_bound(first, values.end(), high);
+    return {static_cast<size_t>(first - values.begin()), static_cast<size_t>(last - values.begin())};
+}
+
+pair<MagicalContainer::AscendingIterator, MagicalContainer::AscendingIterator> MagicalContainer::ascendingRange(int low, int high) {
+    auto positions = positionsOf(*vecElements, low, high);
+    return {AscendingIterator(*this, positions.first), AscendingIterator(*this, positions.second)};
+}
+
+pair<MagicalContainer::PrimeIterator, MagicalContainer::PrimeIterator> MagicalContainer::primeRange(int low, int high) {
+    auto positions = positionsOf(*vecPrime, low, high);
+    return {PrimeIterator(*this, positions.first), PrimeIterator(*this, positions.second)};
+}
+
+size_t MagicalContainer::countRange(int low, int high) const {
+    auto positions = positionsOf(*vecElements, low, high);
+    return positions.second - positions.first;
+}
+
+size_t MagicalContainer::countPrimesInRange(int low, int high) const {
+    auto positions = positionsOf(*vecPrime, low, high);
+    return positions.second - positions.first;
+}
+
+void MagicalContainer::applySetOperation(const MagicalContainer &other, SetOperation operation) {
+    // Hold on to other's storage: other may be this container.
+    shared_ptr<vector<int>> otherElements = other.vecElements;
+    shared_ptr<vector<int>> otherPrimes = other.vecPrime;
+    auto combine = [operation](const vector<int> &first, const vector<int> &second) {
+        switch (operation) {
+            case SetOperation::UNION:
+                return unionSorted(first, second);
+            case SetOperation::INTERSECTION:
+                return intersectSorted(first, second);
+            default:
+                return differenceSorted(first, second);
+        }
+    };
+
+    vecElements = make_shared<vector<int>>(combine(*vecElements, *otherElements));
+    vecPrime = make_shared<vector<int>>(combine(*vecPrime, *otherPrimes));
+    storageVersion = nextVersion();
+    for (FilterIndex &index: filterIndexes) {
+        if (operation == SetOperation::UNION) {
+            vector<int> matching;
+            index.select(*otherElements, matching);
+            index.values = make_shared<vector<int>>(unionSorted(*index.values, matching));
+        } else {
+            index.values = make_shared<vector<int>>(combine(*index.values, *otherElements));
+        }
+    }
+    if (prefixElements) {
+        prefixElements = buildPrefix(*vecElements);
+        prefixPrimes = buildPrefix(*vecPrime);
+    }
+}
+
+void MagicalContainer::unionWith(const MagicalContainer &other) {
+    applySetOperation(other, SetOperation::UNION);
+}
+
+void MagicalContainer::intersectWith(const MagicalContainer &other) {
+    applySetOperation(other, SetOperation::INTERSECTION);
+}
+
+void MagicalContainer::differenceFrom(const MagicalContainer &other) {
+    applySetOperation(other, SetOperation::DIFFERENCE);
+}
+
+MagicalContainer MagicalContainer::unionOf(const MagicalContainer &first, const MagicalContainer &second) {
+    MagicalContainer result = first;
+    result.unionWith(second);
+    return result;
+}
+
+MagicalContainer MagicalContainer::intersectionOf(const MagicalContainer &first, const MagicalContainer &second) {
+    MagicalContainer result = first;
+    result.intersectWith(second);
+    return result;
+}
+
+MagicalContainer MagicalContainer::differenceOf(const MagicalContainer &first, const MagicalContainer &second) {
+    MagicalContainer result = first;
+    result.differenceFrom(second);
+    return result;
+}
+
+void MagicalContainer::enablePrefixSums(bool enabled) {
+    if (!enabled) {
+        prefixElements.reset();
+        prefixPrimes.reset();
+    } else if (!prefixElements) {
+        prefixElements = buildPrefix(*vecElements);
+        prefixPrimes = buildPrefix(*vecPrime);
+    }
+}
+
+bool MagicalContainer::hasPrefixSums() const {
+    return prefixElements != nullptr;
+}
+
+long long MagicalContainer::sumOf(const vector<int> &values, const shared_ptr<vector<long long>> &prefix, int low, int high) {
+    auto positions = positionsOf(values, low, high);
+    if (prefix) {
+        return (*prefix)[positions.second] - (*prefix)[positions.first];
+    }
+    return sumInts(span<const int>(values).subspan(positions.first, positions.second - positions.first));
+}
+
+long long MagicalContainer::rangeSum(int low, int high) const {
+    return sumOf(*vecElements, prefixElements, low, high);
+}
+
+long long MagicalContainer::primeRangeSum(int low, int high) const {
+    return sumOf(*vecPrime, prefixPrimes, low, high);
+}
+
+double MagicalContainer::rangeMean(int low, int high) const {
+    size_t count = countRange(low, high);
+    return count == 0 ? 0.0 : static_cast<double>(rangeSum(low, high)) / static_cast<double>(count);
+}
+
+double MagicalContainer::primeRangeMean(int low, int high) const {
+    size_t count = countPrimesInRange(low, high);
+    return count == 0 ? 0.0 : static_cast<double>(primeRangeSum(low, high)) / static_cast<double>(count);
+}
+
+long long MagicalContainer::sum(Subset subset) const {
+    auto total = [](const vector<int> &values, const shared_ptr<vector<long long>> &prefix) {
+        return prefix ? prefix->back() : sumInts(values);
+    };
+    long long primes = total(*vecPrime, prefixPrimes);
+    if (subset == Subset::PRIMES) {
+        return primes;
+    }
+    long long all = total(*vecElements, prefixElements);
+    return subset == Subset::ALL ? all : all - primes;
+}
+
+size_t MagicalContainer::countMasked(uint32_t mask, uint32_t match, Subset subset) const {
+    size_t primes = ariel::countMasked(*vecPrime, mask, match);
+    if (subset == Subset::PRIMES) {
+        return primes;
+    }
+    size_t all = ariel::countMasked(*vecElements, mask, match);
+    return subset == Subset::ALL ? all : all - primes;
+}
+
+vector<uint64_t> MagicalContainer::histogram(int low, int width, size_t bins, Subset subset) const {
+    if (width <= 0) {
+        throw runtime_error("histogram(): width must be positive");
+    }
+    // Bin i counts [low + i * width, low + (i + 1) * width): one binary search per boundary.
+    auto counts = [&](const vector<int> &values) {
+        vector<size_t> boundaries;
+        for (size_t bin = 0; bin <= bins; ++bin) {
+            long long boundary = static_cast<long long>(low) + static_cast<long long>(bin) * width;
+            if (boundary > INT_MAX) {
+                boundaries.push_back(values.size());
+            } else {
+                auto found = lower_bound(values.begin(), values.end(), static_cast<int>(boundary));
+                boundaries.push_back(static_cast<size_t>(found - values.begin()));
+            }
+        }
+        vector<uint64_t> result(bins);
+        for (size_t bin = 0; bin < bins; ++bin) {
+            result[bin] = boundaries[bin + 1] - boundaries[bin];
+        }
+        return result;
+    };
+    vector<uint64_t> result = counts(subset == Subset::PRIMES ? *vecPrime : *vecElements);
+    if (subset == Subset::NON_PRIMES) {
+        vector<uint64_t> primes = counts(*vecPrime);
+        for (size_t bin = 0; bin < bins; ++bin) {
+            result[bin] -= primes[bin];
+        }
+    }
+    return result;
 }
 
-bool MagicalContainer::isPrime(int number) {
+int MagicalContainer::kth(size_t k) const {
+    if (k >= vecElements->size()) {
+        throw runtime_error("kth(): k is out of range");
+    }
+    return (*vecElements)[k];
+}
+
+size_t MagicalContainer::rank(int value) const {
+    return static_cast<size_t>(lower_bound(vecElements->begin(), vecElements->end(), value) - vecElements->begin());
+}
+
+int MagicalContainer::primeKth(size_t k) const {
+    if (k >= vecPrime->size()) {
+        throw runtime_error("primeKth(): k is out of range");
+    }
+    return (*vecPrime)[k];
+}
+
+size_t MagicalContainer::primeRank(int value) const {
+    return static_cast<size_t>(lower_bound(vecPrime->begin(), vecPrime->end(), value) - vecPrime->begin());
+}
+
+MagicalContainer MagicalContainer::snapshot() const {
+    return *this;
+}
+
+MagicalStats MagicalContainer::stats() const {
+    MagicalStats result;
+#ifdef MAGICAL_STATS
+    result.enabled = true;
+    result.primeChecks = counters.primeChecks.load();
+    result.primeDivisions = counters.primeDivisions.load();
+    result.elementsShifted = counters.elementsShifted.load();
+    result.reallocations = counters.reallocations.load();
+    result.iteratorExceptions = counters.iteratorExceptions.load();
+#endif
+    result.bytesReserved = (vecElements->capacity() + vecPrime->capacity()) * sizeof(int);
+    result.bytesUsed = (vecElements->size() + vecPrime->size()) * sizeof(int);
+    for (const FilterIndex &index: filterIndexes) {
+        result.bytesReserved += index.values->capacity() * sizeof(int);
+        result.bytesUsed += index.values->size() * sizeof(int);
+    }
+    if (prefixElements) {
+        result.bytesReserved += (prefixElements->capacity() + prefixPrimes->capacity()) * sizeof(long long);
+        result.bytesUsed += (prefixElements->size() + prefixPrimes->size()) * sizeof(long long);
+    }
+    return result;
+}
+
+void MagicalContainer::save(int fd) const {
+    const vector<int> &elements = *vecElements;
+    const vector<int> &primes = *vecPrime;
+    vector<uint8_t> buffer(FILE_HEADER_BYTES);
+    memcpy(buffer.data(), FILE_MAGIC, sizeof(FILE_MAGIC));
+    put<uint16_t>(buffer.data(), 4, FILE_VERSION);
+    put<uint16_t>(buffer.data(), 6, 0);
+    put<uint32_t>(buffer.data(), 8, BLOCK_VALUES);
+    put<uint64_t>(buffer.data(), 12, elements.size());
+    put<uint64_t>(buffer.data(), 20, primes.size());
+    put<uint32_t>(buffer.data(), 28, crc32c(buffer.data(), 28));
+    writeAll(fd, buffer.data(), buffer.size());
+
+    size_t nextPrime = 0;
+    for (size_t first = 0; first < elements.size(); first += BLOCK_VALUES) {
+        span<const int> block = span<const int>(elements).subspan(first, min<size_t>(BLOCK_VALUES, elements.size() - first));
+        buffer.assign(BLOCK_HEADER_BYTES, 0);
+        encodeDeltas(block, block[0], buffer);
+        size_t bitmap = buffer.size();
+        buffer.resize(bitmap + (block.size() + 7) / 8, 0);
+        for (size_t i = 0; i < block.size(); ++i) {
+            if (nextPrime < primes.size() && primes[nextPrime] == block[i]) {
+                buffer[bitmap + i / 8] |= static_cast<uint8_t>(1U << (i % 8));
+                ++nextPrime;
+            }
+        }
+        size_t payloadBytes = buffer.size() - BLOCK_HEADER_BYTES;
+        put<uint32_t>(buffer.data(), 0, static_cast<uint32_t>(block.size()));
+        put<int32_t>(buffer.data(), 4, block[0]);
+        put<uint32_t>(buffer.data(), 8, static_cast<uint32_t>(payloadBytes));
+        put<uint32_t>(buffer.data(), 12, crc32c(buffer.data() + BLOCK_HEADER_BYTES, payloadBytes));
+        writeAll(fd, buffer.data(), buffer.size());
+    }
+}
+
+MagicalContainer MagicalContainer::load(int fd) {
+    uint8_t header[FILE_HEADER_BYTES];
+    readAll(fd, header, sizeof(header));
+    if (memcmp(header, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0) {
+        corrupt("bad magic");
+    }
+    auto version = get<uint16_t>(header, 4);
+    if (version != FILE_VERSION) {
+        throw runtime_error("Unsupported container file version " + to_string(version));
+    }
+    if (get<uint32_t>(header, 28) != crc32c(header, 28)) {
+        corrupt("header checksum mismatch");
+    }
+    auto blockValues = get<uint32_t>(header, 8);
+    auto elementCount = get<uint64_t>(header, 12);
+    auto primeCount = get<uint64_t>(header, 20);
+    if (blockValues == 0 || primeCount > elementCount) {
+        corrupt("bad header");
+    }
+    // Every value takes at least one payload byte, so a regular file bounds the count. Storage
+    // for a pipe grows block by block instead of trusting the header.
+    size_t expected = blockValues;
+    struct stat status {};
+    off_t position = lseek(fd, 0, SEEK_CUR);
+    if (fstat(fd, &status) == 0 && S_ISREG(status.st_mode) && position >= 0) {
+        auto remaining = static_cast<uint64_t>(max<off_t>(status.st_size - position, 0));
+        if (elementCount > remaining) {
+            corrupt("element count exceeds file size");
+        }
+        expected = elementCount;
+    }
+
+    vector<int> elements;
+    elements.reserve(min<uint64_t>(elementCount, expected));
+    vector<int> primes;
+    primes.reserve(min<uint64_t>(primeCount, expected));
+    vector<uint8_t> payload;
+    for (size_t done = 0; done < elementCount;) {
+        uint8_t blockHeader[BLOCK_HEADER_BYTES];
+        readAll(fd, blockHeader, sizeof(blockHeader));
+        auto count = get<uint32_t>(blockHeader, 0);
+        auto base = get<int32_t>(blockHeader, 4);
+        auto payloadBytes = get<uint32_t>(blockHeader, 8);
+        size_t bitmapBytes = (count + 7) / 8;
+        if (count == 0 || count > blockValues || count > elementCount - done ||
+            payloadBytes > (count + 3) / 4 + 4 * size_t{count} + bitmapBytes) {
+            corrupt("bad block header");
+        }
+        payload.resize(payloadBytes + DECODE_SLACK);
+        readAll(fd, payload.data(), payloadBytes);
+        if (get<uint32_t>(blockHeader, 12) != crc32c(payload.data(), payloadBytes)) {
+            corrupt("block checksum mismatch");
+        }
+        size_t deltaBytes = encodedDeltaBytes(payload.data(), payloadBytes, count);
+        if (deltaBytes == 0 || deltaBytes + bitmapBytes != payloadBytes) {
+            corrupt("bad block length");
+        }
+        elements.resize(done + count);
+        int *out = elements.data() + done;
+        decodeDeltas(payload.data(), count, base, out);
+        // Deltas wrap, so a damaged one shows up as a value that does not increase.
+        for (size_t i = done > 0 ? 0 : 1; i < count; ++i) {
+            if (out[static_cast<ptrdiff_t>(i) - 1] >= out[i]) {
+                corrupt("values out of order");
+            }
+        }
+        // Bits past the block's last value would index the next block.
+        const uint8_t *bitmap = payload.data() + deltaBytes;
+        if (count % 8 != 0 && (bitmap[bitmapBytes - 1] >> (count % 8)) != 0) {
+            corrupt("bitmap padding set");
+        }
+        // Primes are sparse: visit only the set bits, a 64-bit word at a time.
+        for (size_t word = 0; word < bitmapBytes; word += 8) {
+            uint64_t bits = 0;
+            memcpy(&bits, bitmap + word, min<size_t>(8, bitmapBytes - word));
+            while (bits != 0) {
+                primes.push_back(out[word * 8 + static_cast<size_t>(countr_zero(bits))]);
+                bits &= bits - 1;
+            }
+        }
+        done += count;
+    }
+    if (primes.size() != primeCount) {
+        corrupt("prime count mismatch");
+    }
+    return {std::move(elements), std::move(primes)};
+}
+
+string MagicalStats::toJson() const {
+    return "{\"enabled\": " + string(enabled ? "true" : "false") +
+           ", \"primeChecks\": " + to_string(primeChecks) +
+           ", \"primeDivisions\": " + to_string(primeDivisions) +
+           ", \"elementsShifted\": " + to_string(elementsShifted) +
+           ", \"reallocations\": " + to_string(reallocations) +
+           ", \"iteratorExceptions\": " + to_string(iteratorExceptions) +
+           ", \"bytesReserved\": " + to_string(bytesReserved) +
+           ", \"bytesUsed\": " + to_string(bytesUsed) + "}";
+}
+
+void MagicalContainer::iteratorError(const char *message) const {
+    MAGICAL_STAT_ADD(counters, iteratorExceptions, 1);
+    throw runtime_error(message);
+}
+
+bool MagicalContainer::primeTest(int number, uint64_t &divisions) {
     if (number <= 1) {
         return false;
     }
@@ -46,21 +705,37 @@ bool MagicalContainer::isPrime(int number) {
         return true;
     }
     else if (number % 2 == 0 || number % 3 == 0) {
+        divisions += number % 2 == 0 ? 1U : 2U;
         return false;
     }
 
+    divisions += 2;
     int i = 5;
     while (i * i <= number) {
         if (number % i == 0 || number % (i + 2) == 0) {
+            divisions += number % i == 0 ? 1U : 2U;
             return false;
         }
+        divisions += 2;
         i += 6;
     }
     return true;
 }
 
+bool MagicalContainer::isPrime(int number) const {
+    uint64_t divisions = 0;
+    bool prime = primeTest(number, divisions);
+    MAGICAL_STAT_ADD(counters, primeChecks, 1);
+    MAGICAL_STAT_ADD(counters, primeDivisions, divisions);
+    return prime;
+}
+
 const std::vector<int>& MagicalContainer::getElements() const {
-    return vecElements;
+    return *vecElements;
+}
+
+const std::vector<int>& MagicalContainer::getPrimes() const {
+    return *vecPrime;
 }
 
 // iterator class for iterating over the elements of the MagicalContainer in ascending order. It inherits from a base Iterator class.
@@ -85,7 +760,7 @@ MagicalContainer::AscendingIterator::~AscendingIterator() = default;
 MagicalContainer::AscendingIterator &MagicalContainer::AscendingIterator::operator=(const AscendingIterator &other) {
     if (*this != other) {
         if (&container != &other.container) {
-            throw runtime_error("Error with operator=() :: AscendingIterator!!!");
+            container.iteratorError("Error with operator=() :: AscendingIterator!!!");
         }
         index = other.index;
     }
@@ -94,7 +769,7 @@ MagicalContainer::AscendingIterator &MagicalContainer::AscendingIterator::operat
 
 bool MagicalContainer::AscendingIterator::operator==(const AscendingIterator &other) const {
     if (&container != &other.container) {
-        throw runtime_error("Error with operator==():: AscendingIterator!!!.");
+        container.iteratorError("Error with operator==():: AscendingIterator!!!.");
     }
     return index == other.index;
 }
@@ -105,7 +780,7 @@ bool MagicalContainer::AscendingIterator::operator!=(const AscendingIterator &ot
 
 bool MagicalContainer::AscendingIterator::operator>(const AscendingIterator &other) const {
     if (&container != &other.container) {
-        throw runtime_error("Error with operator>()::: AscendingIterator!!!.");
+        container.iteratorError("Error with operator>()::: AscendingIterator!!!.");
     }
     return index > other.index;
 }
@@ -117,14 +792,15 @@ bool MagicalContainer::AscendingIterator::operator<(const AscendingIterator &oth
 
 int MagicalContainer::AscendingIterator::operator*() const {
     if (index < 0 || index >= container.size()) {
-        throw runtime_error("Iterator out of bound operator*()");
+        container.iteratorError("Iterator out of bound operator*()");
     }
-    return container.vecElements[index];
+    return (*container.vecElements)[index];
 }
 //overload moves the iterator to the next element.
 MagicalContainer::AscendingIterator &MagicalContainer::AscendingIterator::operator++() {
+    LatencyScope latency(LatencyOp::ITERATE);
     if (++index > container.size()) {
-        throw runtime_error("Error with operator++() out bound");
+        container.iteratorError("Error with operator++() out bound");
     }
     return *this;
 }
@@ -147,7 +823,7 @@ size_t MagicalContainer::AscendingIterator::getIndex() const {
 
 bool MagicalContainer::AscendingIterator::operator==(const MagicalContainer::Iterator &other) const {
     if (this->getIterType() != other.getIterType()) {
-        throw runtime_error("Error with operator==()AscendingIterator ");
+        container.iteratorError("Error with operator==()AscendingIterator ");
     }
     const auto &otherAscendingIterator = dynamic_cast<const AscendingIterator &>(other);
     return *this == otherAscendingIterator;
@@ -155,7 +831,7 @@ bool MagicalContainer::AscendingIterator::operator==(const MagicalContainer::Ite
 
 bool MagicalContainer::AscendingIterator::operator!=(const MagicalContainer::Iterator &other) const {
     if (this->getIterType() != other.getIterType()) {
-        throw runtime_error("Error with operator!=() AscendingIterator");
+        container.iteratorError("Error with operator!=() AscendingIterator");
     }
     const auto &otherAscendingIterator = dynamic_cast<const AscendingIterator &>(other);
     return *this != otherAscendingIterator;
@@ -163,7 +839,7 @@ bool MagicalContainer::AscendingIterator::operator!=(const MagicalContainer::Ite
 
 bool MagicalContainer::AscendingIterator::operator>(const MagicalContainer::Iterator &other) const {
     if (this->getIterType() != other.getIterType()) {
-        throw runtime_error("Error with operator>() AscendingIterator");
+        container.iteratorError("Error with operator>() AscendingIterator");
     }
     const auto &otherAscendingIterator = dynamic_cast<const AscendingIterator &>(other);
     return *this > otherAscendingIterator;
@@ -171,7 +847,7 @@ bool MagicalContainer::AscendingIterator::operator>(const MagicalContainer::Iter
 
 bool MagicalContainer::AscendingIterator::operator<(const MagicalContainer::Iterator &other) const {
     if (this->getIterType() != other.getIterType()) {
-        throw runtime_error("Error with operator<() AscendingIterator");
+        container.iteratorError("Error with operator<() AscendingIterator");
     }
     const auto &otherAscendingIterator = dynamic_cast<const AscendingIterator &>(other);
     return *this < otherAscendingIterator;
@@ -197,7 +873,7 @@ MagicalContainer::SideCrossIterator::~SideCrossIterator() = default;
 MagicalContainer::SideCrossIterator &MagicalContainer::SideCrossIterator::operator=(const SideCrossIterator &other) {
     if (*this != other) {
         if (&container != &other.container) {
-            throw runtime_error("Error with operator=()::SideCrossIterator:");
+            container.iteratorError("Error with operator=()::SideCrossIterator:");
         }
         frontIndex = other.frontIndex;
         backIndex = other.backIndex;
@@ -207,7 +883,7 @@ MagicalContainer::SideCrossIterator &MagicalContainer::SideCrossIterator::operat
 // operators MagicalContainer::SideCrossIterator
 bool MagicalContainer::SideCrossIterator::operator==(const SideCrossIterator &other) const {
     if (&container != &other.container) {
-        throw runtime_error("Error with operator==()::SideCrossIterator:");
+        container.iteratorError("Error with operator==()::SideCrossIterator:");
     }
     return (frontIndex == other.frontIndex && backIndex == other.backIndex);
 }
@@ -218,7 +894,7 @@ bool MagicalContainer::SideCrossIterator::operator!=(const SideCrossIterator &ot
 
 bool MagicalContainer::SideCrossIterator::operator>(const SideCrossIterator &other) const {
     if (&container != &other.container) {
-        throw runtime_error("Error with operator>()::SideCrossIterator:");
+        container.iteratorError("Error with operator>()::SideCrossIterator:");
     }
     // The iterator closer to the middle is considered "greater"
     return (min(frontIndex, backIndex) > min(other.frontIndex, other.backIndex));
@@ -226,7 +902,7 @@ bool MagicalContainer::SideCrossIterator::operator>(const SideCrossIterator &oth
 
 bool MagicalContainer::SideCrossIterator::operator<(const SideCrossIterator &other) const {
     if (&container != &other.container) {
-        throw runtime_error("Error with operator<()::SideCrossIterator:");
+        container.iteratorError("Error with operator<()::SideCrossIterator:");
     }
     // The iterator closer to the start/end is considered "lesser"
     return (max(frontIndex, backIndex) < max(other.frontIndex, other.backIndex));
@@ -234,8 +910,9 @@ bool MagicalContainer::SideCrossIterator::operator<(const SideCrossIterator &oth
 
 
 MagicalContainer::SideCrossIterator &MagicalContainer::SideCrossIterator::operator++() {
+    LatencyScope latency(LatencyOp::ITERATE);
     if (frontIndex > backIndex) {
-        throw runtime_error("Error with operator++(): Iterator has reached its end.");
+        container.iteratorError("Error with operator++(): Iterator has reached its end.");
     }
     // If we are at an even count of increments, we increment the front index.
     // Otherwise, we decrement the back index.
@@ -250,18 +927,21 @@ MagicalContainer::SideCrossIterator &MagicalContainer::SideCrossIterator::operat
 
 int MagicalContainer::SideCrossIterator::operator*() const {
     if (frontIndex > backIndex) {
-        throw runtime_error("Error with operator*(): out bound");
+        container.iteratorError("Error with operator*(): out bound");
     }
     // If we are at an even count of increments, we return from the front.
     // Otherwise, we return from the back.
     if (increments % 2 == 0) {
-        return container.vecElements[frontIndex];
+        return (*container.vecElements)[frontIndex];
     } else {
-        return container.vecElements[backIndex];
+        return (*container.vecElements)[backIndex];
     }
 }
 
 MagicalContainer::SideCrossIterator MagicalContainer::SideCrossIterator::begin() {
+    if (container.size() == 0) {
+        return end();
+    }
     return {container, 0, container.size() - 1};
 }
 
@@ -288,7 +968,7 @@ size_t MagicalContainer::SideCrossIterator::getBackIndex() const {
 
 bool MagicalContainer::SideCrossIterator::operator==(const MagicalContainer::Iterator &other) const {
     if (this->getIterType() != other.getIterType()) {
-        throw runtime_error("Error with operator==()::SideCrossIterator");
+        container.iteratorError("Error with operator==()::SideCrossIterator");
     }
     const auto &otherSideCrossIterator = dynamic_cast<const SideCrossIterator &>(other);
     return *this == otherSideCrossIterator;
@@ -296,7 +976,7 @@ bool MagicalContainer::SideCrossIterator::operator==(const MagicalContainer::Ite
 
 bool MagicalContainer::SideCrossIterator::operator!=(const MagicalContainer::Iterator &other) const {
     if (this->getIterType() != other.getIterType()) {
-        throw runtime_error("Error with operator!=()::SideCrossIterator");
+        container.iteratorError("Error with operator!=()::SideCrossIterator");
     }
     const auto &otherSideCrossIterator = dynamic_cast<const SideCrossIterator &>(other);
     return *this != otherSideCrossIterator;
@@ -304,7 +984,7 @@ bool MagicalContainer::SideCrossIterator::operator!=(const MagicalContainer::Ite
 
 bool MagicalContainer::SideCrossIterator::operator>(const MagicalContainer::Iterator &other) const {
     if (this->getIterType() != other.getIterType()) {
-        throw runtime_error("Error with operator>()::SideCrossIterator");
+        container.iteratorError("Error with operator>()::SideCrossIterator");
     }
     const auto &otherSideCrossIterator = dynamic_cast<const SideCrossIterator &>(other);
     return *this > otherSideCrossIterator;
@@ -312,7 +992,7 @@ bool MagicalContainer::SideCrossIterator::operator>(const MagicalContainer::Iter
 
 bool MagicalContainer::SideCrossIterator::operator<(const MagicalContainer::Iterator &other) const {
     if (this->getIterType() != other.getIterType()) {
-        throw runtime_error("Error with operator<()::SideCrossIterator");
+        container.iteratorError("Error with operator<()::SideCrossIterator");
     }
     const auto &otherSideCrossIterator = dynamic_cast<const SideCrossIterator &>(other);
     return *this < otherSideCrossIterator;
@@ -335,7 +1015,7 @@ MagicalContainer::PrimeIterator::~PrimeIterator() = default;
 MagicalContainer::PrimeIterator &MagicalContainer::PrimeIterator::operator=(const PrimeIterator &other) {
     if (*this != other) {
         if (&container != &other.container) {
-            throw runtime_error("Error with operator=()::PrimeIterator");
+            container.iteratorError("Error with operator=()::PrimeIterator");
         }
         index = other.index;
     }
@@ -344,7 +1024,7 @@ MagicalContainer::PrimeIterator &MagicalContainer::PrimeIterator::operator=(cons
 
 bool MagicalContainer::PrimeIterator::operator==(const PrimeIterator &other) const {
     if (&container != &other.container) {
-        throw runtime_error("Error with operator==()::PrimeIterator");
+        container.iteratorError("Error with operator==()::PrimeIterator");
     }
     return index == other.index;
 }
@@ -355,7 +1035,7 @@ bool MagicalContainer::PrimeIterator::operator!=(const PrimeIterator &other) con
 
 bool MagicalContainer::PrimeIterator::operator>(const PrimeIterator &other) const {
     if (&container != &other.container) {
-        throw runtime_error("Error with operator>()::PrimeIterator");
+        container.iteratorError("Error with operator>()::PrimeIterator");
     }
     return index > other.index;
 }
@@ -366,15 +1046,16 @@ bool MagicalContainer::PrimeIterator::operator<(const PrimeIterator &other) cons
 }
 
 int MagicalContainer::PrimeIterator::operator*() const {
-    if (index < 0 || index >= container.vecPrime.size()) {
-        throw runtime_error("Error with operator*()::PrimeIterator");
+    if (index < 0 || index >= container.vecPrime->size()) {
+        container.iteratorError("Error with operator*()::PrimeIterator");
     }
-    return container.vecPrime[index];
+    return (*container.vecPrime)[index];
 }
 
 MagicalContainer::PrimeIterator &MagicalContainer::PrimeIterator::operator++() {
-    if (++index > container.vecPrime.size()) {
-        throw runtime_error("Error with operator++()::PrimeIterator");
+    LatencyScope latency(LatencyOp::ITERATE);
+    if (++index > container.vecPrime->size()) {
+        container.iteratorError("Error with operator++()::PrimeIterator");
     }
     return *this;
 }
@@ -384,7 +1065,7 @@ MagicalContainer::PrimeIterator MagicalContainer::PrimeIterator::begin() {
 }
 
 MagicalContainer::PrimeIterator MagicalContainer::PrimeIterator::end() {
-    return PrimeIterator(container, container.vecPrime.size());
+    return PrimeIterator(container, container.vecPrime->size());
 }
 
 MagicalContainer &MagicalContainer::PrimeIterator::getContainer() const {
@@ -398,7 +1079,7 @@ size_t MagicalContainer::PrimeIterator::getIndex() const {
 
 bool MagicalContainer::PrimeIterator::operator==(const MagicalContainer::Iterator &other) const {
     if (this->getIterType() != other.getIterType()) {
-        throw runtime_error("Error with operator==()::PrimeIterator");
+        container.iteratorError("Error with operator==()::PrimeIterator");
     }
     const auto &otherPrimeIterator = dynamic_cast<const PrimeIterator &>(other);
     return *this == otherPrimeIterator;
@@ -406,7 +1087,7 @@ bool MagicalContainer::PrimeIterator::operator==(const MagicalContainer::Iterato
 
 bool MagicalContainer::PrimeIterator::operator!=(const MagicalContainer::Iterator &other) const {
     if (this->getIterType() != other.getIterType()) {
-        throw runtime_error("Error with operator!=()::PrimeIterator");
+        container.iteratorError("Error with operator!=()::PrimeIterator");
     }
     const auto &otherPrimeIterator = dynamic_cast<const PrimeIterator &>(other);
     return *this != otherPrimeIterator;
@@ -414,7 +1095,7 @@ bool MagicalContainer::PrimeIterator::operator!=(const MagicalContainer::Iterato
 
 bool MagicalContainer::PrimeIterator::operator>(const MagicalContainer::Iterator &other) const {
     if (this->getIterType() != other.getIterType()) {
-        throw runtime_error("Error with operator>()::PrimeIterator");
+        container.iteratorError("Error with operator>()::PrimeIterator");
     }
     const auto &otherPrimeIterator = dynamic_cast<const PrimeIterator &>(other);
     return *this > otherPrimeIterator;
@@ -422,14 +1103,651 @@ bool MagicalContainer::PrimeIterator::operator>(const MagicalContainer::Iterator
 
 bool MagicalContainer::PrimeIterator::operator<(const MagicalContainer::Iterator &other) const {
     if (this->getIterType() != other.getIterType()) {
-        throw runtime_error("Error with operator<()::PrimeIterator");
+        container.iteratorError("Error with operator<()::PrimeIterator");
     }
     const auto &otherPrimeIterator = dynamic_cast<const PrimeIterator &>(other);
     return *this < otherPrimeIterator;
 }
 
+// Walks the elements from the largest to the smallest. index counts the steps taken,
+// so the element is read from the back of the live storage.
+MagicalContainer::DescendingIterator::DescendingIterator() : Iterator(IteratorType::DESCENDING), container(*new MagicalContainer()), index(0) {
+}
+
+MagicalContainer::DescendingIterator::DescendingIterator(MagicalContainer &container) : Iterator(IteratorType::DESCENDING), container(container), index(0) {
+}
+
+MagicalContainer::DescendingIterator::DescendingIterator(MagicalContainer &container, size_t index) : Iterator(IteratorType::DESCENDING), container(container), index(index) {
+}
+
+MagicalContainer::DescendingIterator::DescendingIterator(const DescendingIterator &other) : Iterator(IteratorType::DESCENDING), container(other.container), index(other.index) {
+}
+
+MagicalContainer::DescendingIterator::~DescendingIterator() = default;
+
+MagicalContainer::DescendingIterator &MagicalContainer::DescendingIterator::operator=(const DescendingIterator &other) {
+    if (*this != other) {
+        if (&container != &other.container) {
+            container.iteratorError("Error with operator=()::DescendingIterator");
+        }
+        index = other.index;
+    }
+    return *this;
+}
+
+bool MagicalContainer::DescendingIterator::operator==(const DescendingIterator &other) const {
+    if (&container != &other.container) {
+        container.iteratorError("Error with operator==()::DescendingIterator");
+    }
+    return index == other.index;
+}
+
+bool MagicalContainer::DescendingIterator::operator!=(const DescendingIterator &other) const {
+    return !(*this == other);
+}
+
+bool MagicalContainer::DescendingIterator::operator>(const DescendingIterator &other) const {
+    if (&container != &other.container) {
+        container.iteratorError("Error with operator>()::DescendingIterator");
+    }
+    return index > other.index;
+}
+
+bool MagicalContainer::DescendingIterator::operator<(const DescendingIterator &other) const {
+    return !(*this > other || *this == other);
+}
+
+int MagicalContainer::DescendingIterator::operator*() const {
+    size_t count = container.size();
+    if (index >= count) {
+        container.iteratorError("Error with operator*()::DescendingIterator");
+    }
+    return (*container.vecElements)[count - 1 - index];
+}
+
+MagicalContainer::DescendingIterator &MagicalContainer::DescendingIterator::operator++() {
+    LatencyScope latency(LatencyOp::ITERATE);
+    if (++index > container.size()) {
+        container.iteratorError("Error with operator++()::DescendingIterator");
+    }
+    return *this;
+}
+
+MagicalContainer::DescendingIterator MagicalContainer::DescendingIterator::begin() {
+    return {container, 0};
+}
+
+MagicalContainer::DescendingIterator MagicalContainer::DescendingIterator::end() {
+    return {container, container.size()};
+}
+
+MagicalContainer &MagicalContainer::DescendingIterator::getContainer() const {
+    return container;
+}
+
+size_t MagicalContainer::DescendingIterator::getIndex() const {
+    return index;
+}
+
+bool MagicalContainer::DescendingIterator::operator==(const MagicalContainer::Iterator &other) const {
+    if (this->getIterType() != other.getIterType()) {
+        container.iteratorError("Error with operator==()::DescendingIterator");
+    }
+    const auto &otherDescendingIterator = dynamic_cast<const DescendingIterator &>(other);
+    return *this == otherDescendingIterator;
+}
+
+bool MagicalContainer::DescendingIterator::operator!=(const MagicalContainer::Iterator &other) const {
+    if (this->getIterType() != other.getIterType()) {
+        container.iteratorError("Error with operator!=()::DescendingIterator");
+    }
+    const auto &otherDescendingIterator = dynamic_cast<const DescendingIterator &>(other);
+    return *this != otherDescendingIterator;
+}
+
+bool MagicalContainer::DescendingIterator::operator>(const MagicalContainer::Iterator &other) const {
+    if (this->getIterType() != other.getIterType()) {
+        container.iteratorError("Error with operator>()::DescendingIterator");
+    }
+    const auto &otherDescendingIterator = dynamic_cast<const DescendingIterator &>(other);
+    return *this > otherDescendingIterator;
+}
+
+bool MagicalContainer::DescendingIterator::operator<(const MagicalContainer::Iterator &other) const {
+    if (this->getIterType() != other.getIterType()) {
+        container.iteratorError("Error with operator<()::DescendingIterator");
+    }
+    const auto &otherDescendingIterator = dynamic_cast<const DescendingIterator &>(other);
+    return *this < otherDescendingIterator;
+}
+
+// Side-cross order played backwards: starts in the middle and moves outwards,
+// alternating sides, ending with the first element.
+MagicalContainer::ReverseSideCrossIterator::ReverseSideCrossIterator() : Iterator(IteratorType::REVERSE_SIDE_CROSS), container(*new MagicalContainer()), index(0) {
+}
+
+MagicalContainer::ReverseSideCrossIterator::ReverseSideCrossIterator(MagicalContainer &container) : Iterator(IteratorType::REVERSE_SIDE_CROSS), container(container), index(0) {
+}
+
+MagicalContainer::ReverseSideCrossIterator::ReverseSideCrossIterator(MagicalContainer &container, size_t index) : Iterator(IteratorType::REVERSE_SIDE_CROSS), container(container), index(index) {
+}
+
+MagicalContainer::ReverseSideCrossIterator::ReverseSideCrossIterator(const ReverseSideCrossIterator &other) : Iterator(IteratorType::REVERSE_SIDE_CROSS), container(other.container), index(other.index) {
+}
+
+MagicalContainer::ReverseSideCrossIterator::~ReverseSideCrossIterator() = default;
+
+MagicalContainer::ReverseSideCrossIterator &MagicalContainer::ReverseSideCrossIterator::operator=(const ReverseSideCrossIterator &other) {
+    if (*this != other) {
+        if (&container != &other.container) {
+            container.iteratorError("Error with operator=()::ReverseSideCrossIterator");
+        }
+        index = other.index;
+    }
+    return *this;
+}
+
+bool MagicalContainer::ReverseSideCrossIterator::operator==(const ReverseSideCrossIterator &other) const {
+    if (&container != &other.container) {
+        container.iteratorError("Error with operator==()::ReverseSideCrossIterator");
+    }
+    return index == other.index;
+}
+
+bool MagicalContainer::ReverseSideCrossIterator::operator!=(const ReverseSideCrossIterator &other) const {
+    return !(*this == other);
+}
+
+bool MagicalContainer::ReverseSideCrossIterator::operator>(const ReverseSideCrossIterator &other) const {
+    if (&container != &other.container) {
+        container.iteratorError("Error with operator>()::ReverseSideCrossIterator");
+    }
+    return index > other.index;
+}
+
+bool MagicalContainer::ReverseSideCrossIterator::operator<(const ReverseSideCrossIterator &other) const {
+    return !(*this > other || *this == other);
+}
+
+int MagicalContainer::ReverseSideCrossIterator::operator*() const {
+    size_t count = container.size();
+    if (index >= count) {
+        container.iteratorError("Error with operator*()::ReverseSideCrossIterator");
+    }
+    // Step k visits what SideCrossIterator visits at step count - 1 - k:
+    // even side-cross steps come from the front, odd ones from the back.
+    size_t step = count - 1 - index;
+    if (step % 2 == 0) {
+        return (*container.vecElements)[step / 2];
+    }
+    return (*container.vecElements)[count - 1 - step / 2];
+}
+
+MagicalContainer::ReverseSideCrossIterator &MagicalContainer::ReverseSideCrossIterator::operator++() {
+    LatencyScope latency(LatencyOp::ITERATE);
+    if (++index > container.size()) {
+        container.iteratorError("Error with operator++()::ReverseSideCrossIterator");
+    }
+    return *this;
+}
+
+MagicalContainer::ReverseSideCrossIterator MagicalContainer::ReverseSideCrossIterator::begin() {
+    return {container, 0};
+}
+
+MagicalContainer::ReverseSideCrossIterator MagicalContainer::ReverseSideCrossIterator::end() {
+    return {container, container.size()};
+}
+
+MagicalContainer &MagicalContainer::ReverseSideCrossIterator::getContainer() const {
+    return container;
+}
+
+size_t MagicalContainer::ReverseSideCrossIterator::getIndex() const {
+    return index;
+}
+
+bool MagicalContainer::ReverseSideCrossIterator::operator==(const MagicalContainer::Iterator &other) const {
+    if (this->getIterType() != other.getIterType()) {
+        container.iteratorError("Error with operator==()::ReverseSideCrossIterator");
+    }
+    const auto &otherReverseSideCrossIterator = dynamic_cast<const ReverseSideCrossIterator &>(other);
+    return *this == otherReverseSideCrossIterator;
+}
+
+bool MagicalContainer::ReverseSideCrossIterator::operator!=(const MagicalContainer::Iterator &other) const {
+    if (this->getIterType() != other.getIterType()) {
+        container.iteratorError("Error with operator!=()::ReverseSideCrossIterator");
+    }
+    const auto &otherReverseSideCrossIterator = dynamic_cast<const ReverseSideCrossIterator &>(other);
+    return *this != otherReverseSideCrossIterator;
+}
+
+bool MagicalContainer::ReverseSideCrossIterator::operator>(const MagicalContainer::Iterator &other) const {
+    if (this->getIterType() != other.getIterType()) {
+        container.iteratorError("Error with operator>()::ReverseSideCrossIterator");
+    }
+    const auto &otherReverseSideCrossIterator = dynamic_cast<const ReverseSideCrossIterator &>(other);
+    return *this > otherReverseSideCrossIterator;
+}
+
+bool MagicalContainer::ReverseSideCrossIterator::operator<(const MagicalContainer::Iterator &other) const {
+    if (this->getIterType() != other.getIterType()) {
+        container.iteratorError("Error with operator<()::ReverseSideCrossIterator");
+    }
+    const auto &otherReverseSideCrossIterator = dynamic_cast<const ReverseSideCrossIterator &>(other);
+    return *this < otherReverseSideCrossIterator;
+}
+
+// Walks the primes from the largest to the smallest.
+MagicalContainer::ReversePrimeIterator::ReversePrimeIterator() : Iterator(IteratorType::REVERSE_PRIME), container(*new MagicalContainer()), index(0) {
+}
+
+MagicalContainer::ReversePrimeIterator::ReversePrimeIterator(MagicalContainer &container) : Iterator(IteratorType::REVERSE_PRIME), container(container), index(0) {
+}
+
+MagicalContainer::ReversePrimeIterator::ReversePrimeIterator(MagicalContainer &container, size_t index) : Iterator(IteratorType::REVERSE_PRIME), container(container), index(index) {
+}
+
+MagicalContainer::ReversePrimeIterator::ReversePrimeIterator(const ReversePrimeIterator &other) : Iterator(IteratorType::REVERSE_PRIME), container(other.container), index(other.index) {
+}
+
+MagicalContainer::ReversePrimeIterator::~ReversePrimeIterator() = default;
+
+MagicalContainer::ReversePrimeIterator &MagicalContainer::ReversePrimeIterator::operator=(const ReversePrimeIterator &other) {
+    if (*this != other) {
+        if (&container != &other.container) {
+            container.iteratorError("Error with operator=()::ReversePrimeIterator");
+        }
+        index = other.index;
+    }
+    return *this;
+}
+
+bool MagicalContainer::ReversePrimeIterator::operator==(const ReversePrimeIterator &other) const {
+    if (&container != &other.container) {
+        container.iteratorError("Error with operator==()::ReversePrimeIterator");
+    }
+    return index == other.index;
+}
+
+bool MagicalContainer::ReversePrimeIterator::operator!=(const ReversePrimeIterator &other) const {
+    return !(*this == other);
+}
+
+bool MagicalContainer::ReversePrimeIterator::operator>(const ReversePrimeIterator &other) const {
+    if (&container != &other.container) {
+        container.iteratorError("Error with operator>()::ReversePrimeIterator");
+    }
+    return index > other.index;
+}
+
+bool MagicalContainer::ReversePrimeIterator::operator<(const ReversePrimeIterator &other) const {
+    return !(*this > other || *this == other);
+}
+
+int MagicalContainer::ReversePrimeIterator::operator*() const {
+    size_t count = container.vecPrime->size();
+    if (index >= count) {
+        container.iteratorError("Error with operator*()::ReversePrimeIterator");
+    }
+    return (*container.vecPrime)[count - 1 - index];
+}
+
+MagicalContainer::ReversePrimeIterator &MagicalContainer::ReversePrimeIterator::operator++() {
+    LatencyScope latency(LatencyOp::ITERATE);
+    if (++index > container.vecPrime->size()) {
+        container.iteratorError("Error with operator++()::ReversePrimeIterator");
+    }
+    return *this;
+}
+
+MagicalContainer::ReversePrimeIterator MagicalContainer::ReversePrimeIterator::begin() {
+    return {container, 0};
+}
+
+MagicalContainer::ReversePrimeIterator MagicalContainer::ReversePrimeIterator::end() {
+    return {container, container.vecPrime->size()};
+}
+
+MagicalContainer &MagicalContainer::ReversePrimeIterator::getContainer() const {
+    return container;
+}
+
+size_t MagicalContainer::ReversePrimeIterator::getIndex() const {
+    return index;
+}
+
+bool MagicalContainer::ReversePrimeIterator::operator==(const MagicalContainer::Iterator &other) const {
+    if (this->getIterType() != other.getIterType()) {
+        container.iteratorError("Error with operator==()::ReversePrimeIterator");
+    }
+    const auto &otherReversePrimeIterator = dynamic_cast<const ReversePrimeIterator &>(other);
+    return *this == otherReversePrimeIterator;
+}
+
+bool MagicalContainer::ReversePrimeIterator::operator!=(const MagicalContainer::Iterator &other) const {
+    if (this->getIterType() != other.getIterType()) {
+        container.iteratorError("Error with operator!=()::ReversePrimeIterator");
+    }
+    const auto &otherReversePrimeIterator = dynamic_cast<const ReversePrimeIterator &>(other);
+    return *this != otherReversePrimeIterator;
+}
+
+bool MagicalContainer::ReversePrimeIterator::operator>(const MagicalContainer::Iterator &other) const {
+    if (this->getIterType() != other.getIterType()) {
+        container.iteratorError("Error with operator>()::ReversePrimeIterator");
+    }
+    const auto &otherReversePrimeIterator = dynamic_cast<const ReversePrimeIterator &>(other);
+    return *this > otherReversePrimeIterator;
+}
+
+bool MagicalContainer::ReversePrimeIterator::operator<(const MagicalContainer::Iterator &other) const {
+    if (this->getIterType() != other.getIterType()) {
+        container.iteratorError("Error with operator<()::ReversePrimeIterator");
+    }
+    const auto &otherReversePrimeIterator = dynamic_cast<const ReversePrimeIterator &>(other);
+    return *this < otherReversePrimeIterator;
+}
+
+MagicalContainer::ComposedIterator::ComposedIterator() : ComposedIterator(*new MagicalContainer(), Order::ASCENDING, Subset::ALL) {
+}
+
+MagicalContainer::ComposedIterator::ComposedIterator(MagicalContainer &container, Order order, Subset subset) : ComposedIterator(container, order, subset, 0) {
+}
 
+MagicalContainer::ComposedIterator::ComposedIterator(MagicalContainer &container, Order order, Subset subset, size_t index)
+        : Iterator(IteratorType::COMPOSED), container(container), order(order), subset(subset), index(index) {
+}
 
+MagicalContainer::ComposedIterator::ComposedIterator(const ComposedIterator &other) = default;
 
+MagicalContainer::ComposedIterator::~ComposedIterator() = default;
 
+// Select: the position in the subset's sorted index that step `step` of the order visits.
+size_t MagicalContainer::ComposedIterator::position(size_t step, size_t count) const {
+    switch (order) {
+        case Order::DESCENDING:
+            return count - 1 - step;
+        case Order::SIDE_CROSS:
+            return step % 2 == 0 ? step / 2 : count - 1 - step / 2;
+        default:
+            return step;
+    }
+}
 
+const MagicalContainer::ComposedIterator &MagicalContainer::ComposedIterator::sameComposition(const Iterator &other) const {
+    if (this->getIterType() != other.getIterType()) {
+        container.iteratorError("Error with comparing ComposedIterator to another iterator type");
+    }
+    const auto &otherComposed = dynamic_cast<const ComposedIterator &>(other);
+    if (order != otherComposed.order || subset != otherComposed.subset) {
+        container.iteratorError("Error with comparing ComposedIterators of different compositions");
+    }
+    return otherComposed;
+}
+
+MagicalContainer::ComposedIterator &MagicalContainer::ComposedIterator::operator=(const ComposedIterator &other) {
+    if (&container != &other.container) {
+        container.iteratorError("Error with operator=()::ComposedIterator");
+    }
+    sameComposition(other);
+    index = other.index;
+    return *this;
+}
+
+bool MagicalContainer::ComposedIterator::operator==(const ComposedIterator &other) const {
+    if (&container != &other.container) {
+        container.iteratorError("Error with operator==()::ComposedIterator");
+    }
+    sameComposition(other);
+    return index == other.index;
+}
+
+bool MagicalContainer::ComposedIterator::operator!=(const ComposedIterator &other) const {
+    return !(*this == other);
+}
+
+bool MagicalContainer::ComposedIterator::operator>(const ComposedIterator &other) const {
+    if (&container != &other.container) {
+        container.iteratorError("Error with operator>()::ComposedIterator");
+    }
+    sameComposition(other);
+    return index > other.index;
+}
+
+bool MagicalContainer::ComposedIterator::operator<(const ComposedIterator &other) const {
+    return !(*this > other || *this == other);
+}
+
+bool MagicalContainer::ComposedIterator::operator==(const MagicalContainer::Iterator &other) const {
+    return *this == sameComposition(other);
+}
+
+bool MagicalContainer::ComposedIterator::operator!=(const MagicalContainer::Iterator &other) const {
+    return *this != sameComposition(other);
+}
+
+bool MagicalContainer::ComposedIterator::operator>(const MagicalContainer::Iterator &other) const {
+    return *this > sameComposition(other);
+}
+
+bool MagicalContainer::ComposedIterator::operator<(const MagicalContainer::Iterator &other) const {
+    return *this < sameComposition(other);
+}
+
+int MagicalContainer::ComposedIterator::operator*() const {
+    size_t count = container.subsetSize(subset);
+    if (index >= count) {
+        container.iteratorError("Error with operator*()::ComposedIterator");
+    }
+    return container.subsetAt(subset, position(index, count));
+}
+
+MagicalContainer::ComposedIterator &MagicalContainer::ComposedIterator::operator++() {
+    LatencyScope latency(LatencyOp::ITERATE);
+    if (++index > container.subsetSize(subset)) {
+        container.iteratorError("Error with operator++()::ComposedIterator");
+    }
+    return *this;
+}
+
+MagicalContainer::ComposedIterator MagicalContainer::ComposedIterator::begin() {
+    return {container, order, subset, 0};
+}
+
+MagicalContainer::ComposedIterator MagicalContainer::ComposedIterator::end() {
+    return {container, order, subset, container.subsetSize(subset)};
+}
+
+MagicalContainer &MagicalContainer::ComposedIterator::getContainer() const {
+    return container;
+}
+
+size_t MagicalContainer::ComposedIterator::getIndex() const {
+    return index;
+}
+
+MagicalContainer::Order MagicalContainer::ComposedIterator::getOrder() const {
+    return order;
+}
+
+MagicalContainer::Subset MagicalContainer::ComposedIterator::getSubset() const {
+    return subset;
+}
+
+MagicalContainer::SampleIterator::SampleIterator() : SampleIterator(*new MagicalContainer(), 0, 0) {
+}
+
+MagicalContainer::SampleIterator::SampleIterator(MagicalContainer &container, size_t sampleCount, uint64_t seed,
+                                                 bool withReplacement, Subset subset)
+        : Iterator(IteratorType::SAMPLE), container(container), subset(subset), sampleCount(sampleCount),
+          population(container.subsetSize(subset)), withReplacement(withReplacement), seed(seed), state(seed),
+          index(0), current(0) {
+    if (!withReplacement) {
+        this->sampleCount = min(sampleCount, population);
+    } else if (population == 0) {
+        this->sampleCount = 0;
+    }
+    draw();
+}
+
+MagicalContainer::SampleIterator::SampleIterator(const SampleIterator &other) = default;
+
+// Position-only copy used for end(): it never draws, so the shuffle state is left behind.
+MagicalContainer::SampleIterator::SampleIterator(const SampleIterator &other, size_t index)
+        : Iterator(IteratorType::SAMPLE), container(other.container), subset(other.subset), sampleCount(other.sampleCount), population(other.population), withReplacement(other.withReplacement),
+          seed(other.seed), state(other.state), index(index), current(0) {
+}
+
+MagicalContainer::SampleIterator::~SampleIterator() = default;
+
+// splitmix64
+uint64_t MagicalContainer::SampleIterator::nextRandom() {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Unbiased value in [0, bound) by Lemire's multiply-and-reject.
+size_t MagicalContainer::SampleIterator::nextBelow(size_t bound) {
+    auto range = static_cast<uint64_t>(bound);
+    unsigned __int128 product = static_cast<unsigned __int128>(nextRandom()) * range;
+    auto low = static_cast<uint64_t>(product);
+    if (low < range) {
+        uint64_t threshold = (0 - range) % range;
+        while (low < threshold) {
+            product = static_cast<unsigned __int128>(nextRandom()) * range;
+            low = static_cast<uint64_t>(product);
+        }
+    }
+    return static_cast<size_t>(product >> 64);
+}
+
+// Picks the position of sample number `index`.
+void MagicalContainer::SampleIterator::draw() {
+    if (index >= sampleCount) {
+        return;
+    }
+    if (withReplacement) {
+        current = nextBelow(population);
+        return;
+    }
+    // Swap position index with a random later one, remembering only the displaced entries.
+    size_t pick = index + nextBelow(population - index);
+    auto found = swapped.find(pick);
+    current = found == swapped.end() ? pick : found->second;
+    // Position index is consumed, so its entry goes before pick's is inserted (which may rehash).
+    size_t displaced = index;
+    auto atIndex = swapped.find(index);
+    if (atIndex != swapped.end()) {
+        displaced = atIndex->second;
+        swapped.erase(atIndex);
+    }
+    if (pick != index) {
+        swapped[pick] = displaced;
+    }
+}
+
+MagicalContainer::SampleIterator &MagicalContainer::SampleIterator::operator=(const SampleIterator &other) {
+    if (&container != &other.container) {
+        container.iteratorError("Error with operator=()::SampleIterator");
+    }
+    subset = other.subset;
+    sampleCount = other.sampleCount;
+    population = other.population;
+    withReplacement = other.withReplacement;
+    seed = other.seed;
+    state = other.state;
+    index = other.index;
+    current = other.current;
+    swapped = other.swapped;
+    return *this;
+}
+
+bool MagicalContainer::SampleIterator::operator==(const SampleIterator &other) const {
+    if (&container != &other.container) {
+        container.iteratorError("Error with operator==()::SampleIterator");
+    }
+    return index == other.index;
+}
+
+bool MagicalContainer::SampleIterator::operator!=(const SampleIterator &other) const {
+    return !(*this == other);
+}
+
+bool MagicalContainer::SampleIterator::operator>(const SampleIterator &other) const {
+    if (&container != &other.container) {
+        container.iteratorError("Error with operator>()::SampleIterator");
+    }
+    return index > other.index;
+}
+
+bool MagicalContainer::SampleIterator::operator<(const SampleIterator &other) const {
+    return !(*this > other || *this == other);
+}
+
+int MagicalContainer::SampleIterator::operator*() const {
+    if (index >= sampleCount || current >= container.subsetSize(subset)) {
+        container.iteratorError("Error with operator*()::SampleIterator");
+    }
+    return container.subsetAt(subset, current);
+}
+
+MagicalContainer::SampleIterator &MagicalContainer::SampleIterator::operator++() {
+    LatencyScope latency(LatencyOp::ITERATE);
+    if (++index > sampleCount) {
+        container.iteratorError("Error with operator++()::SampleIterator");
+    }
+    draw();
+    return *this;
+}
+
+MagicalContainer::SampleIterator MagicalContainer::SampleIterator::begin() {
+    return {container, sampleCount, seed, withReplacement, subset};
+}
+
+MagicalContainer::SampleIterator MagicalContainer::SampleIterator::end() {
+    return {*this, sampleCount};
+}
+
+MagicalContainer &MagicalContainer::SampleIterator::getContainer() const {
+    return container;
+}
+
+size_t MagicalContainer::SampleIterator::getIndex() const {
+    return index;
+}
+
+bool MagicalContainer::SampleIterator::operator==(const MagicalContainer::Iterator &other) const {
+    if (this->getIterType() != other.getIterType()) {
+        container.iteratorError("Error with operator==()::SampleIterator");
+    }
+    const auto &otherSampleIterator = dynamic_cast<const SampleIterator &>(other);
+    return *this == otherSampleIterator;
+}
+
+bool MagicalContainer::SampleIterator::operator!=(const MagicalContainer::Iterator &other) const {
+    if (this->getIterType() != other.getIterType()) {
+        container.iteratorError("Error with operator!=()::SampleIterator");
+    }
+    const auto &otherSampleIterator = dynamic_cast<const SampleIterator &>(other);
+    return *this != otherSampleIterator;
+}
+
+bool MagicalContainer::SampleIterator::operator>(const MagicalContainer::Iterator &other) const {
+    if (this->getIterType() != other.getIterType()) {
+        container.iteratorError("Error with operator>()::SampleIterator");
+    }
+    const auto &otherSampleIterator = dynamic_cast<const SampleIterator &>(other);
+    return *this > otherSampleIterator;
+}
+
+bool MagicalContainer::SampleIterator::operator<(const MagicalContainer::Iterator &other) const {
+    if (this->getIterType() != other.getIterType()) {
+        container.iteratorError("Error with operator<()::SampleIterator");
+    }
+    const auto &otherSampleIterator = dynamic_cast<const SampleIterator &>(other);
+    return *this < otherSampleIterator;
+}
@@ -4,25 +4,263 @@
 #include <vector>
 #include <stdexcept>
 #include <algorithm>
+#include <climits>
+#include <memory>
+#include <mutex>
+#include <ranges>
+#include <span>
+#include <typeindex>
+#include <unordered_map>
+#include <utility>
 #include "cmath"
+#include "MagicalStats.hpp"
+#include "LatencyHistogram.hpp"
+#include "SetAlgebra.hpp"
+#include "BulkLoad.hpp"
+#include "Reductions.hpp"
+#include "ArrowCData.h"
 
 using namespace std;
 namespace ariel {
 
     class MagicalContainer {
     private:
-        vector<int> vecElements;
-        vector<int> vecPrime;
-        static bool isPrime(int number);
+        // Storage is shared copy-on-write between a container and its snapshots.
+        // Each vector is detached separately, so a mutation only copies the vector it touches.
+        shared_ptr<vector<int>> vecElements;
+        shared_ptr<vector<int>> vecPrime;
+
+        // Sorted members of one registered predicate class, kept current by addElement/removeElement.
+        // Both hooks are instantiated per Pred, so the predicate is inlined: `matches` costs one
+        // indirect call per single-element mutation, `select` one per run of a bulk mutation.
+        struct FilterIndex {
+            type_index predicate;
+            bool (*matches)(int);
+            // Appends the members of `run` that Pred accepts to `out`.
+            void (*select)(span<const int> run, vector<int> &out);
+            shared_ptr<vector<int>> values;
+        };
+
+        template <typename Pred>
+        static void selectMatching(span<const int> run, vector<int> &out) {
+            Pred pred;
+            for (int value: run) {
+                if (pred(value)) {
+                    out.push_back(value);
+                }
+            }
+        }
+        vector<FilterIndex> filterIndexes;
+
+        // Optional prefix sums: prefix[i] is the sum of the first i values (size n + 1).
+        // Null while disabled.
+        shared_ptr<vector<long long>> prefixElements;
+        shared_ptr<vector<long long>> prefixPrimes;
+        // Restamped from a process-wide counter whenever the elements or primes change.
+        uint64_t storageVersion;
+        static uint64_t nextVersion();
+#ifdef MAGICAL_STATS
+        struct Counters {
+            StatCounter primeChecks;
+            StatCounter primeDivisions;
+            StatCounter elementsShifted;
+            StatCounter reallocations;
+            StatCounter iteratorExceptions;
+        };
+        mutable Counters counters;
+#endif
+        static bool primeTest(int number, uint64_t &divisions);
+        bool isPrime(int number) const;
+        template <typename T>
+        static vector<T> &detach(shared_ptr<vector<T>> &vec);
+        static pair<size_t, size_t> positionsOf(const vector<int> &values, int low, int high);
+        void insertAt(shared_ptr<vector<int>> &vec, ptrdiff_t pos, int element);
+        void eraseAt(shared_ptr<vector<int>> &vec, ptrdiff_t pos);
+        [[noreturn]] void iteratorError(const char *message) const;
+        ptrdiff_t insertSorted(shared_ptr<vector<int>> &vec, int element);
+        ptrdiff_t eraseSorted(shared_ptr<vector<int>> &vec, int element);
+        static void prefixInsert(shared_ptr<vector<long long>> &prefix, ptrdiff_t pos, int element);
+        static void prefixErase(shared_ptr<vector<long long>> &prefix, ptrdiff_t pos, int element);
+        static shared_ptr<vector<long long>> buildPrefix(const vector<int> &values);
+        enum class SetOperation { UNION, INTERSECTION, DIFFERENCE };
+        void applySetOperation(const MagicalContainer &other, SetOperation operation);
+        static long long sumOf(const vector<int> &values, const shared_ptr<vector<long long>> &prefix, int low, int high);
+        static size_t sideCrossPosition(size_t step, size_t count) {
+            return step % 2 == 0 ? step / 2 : count - 1 - step / 2;
+        }
+
+        // Adopts already sorted, duplicate-free elements and their primes without reclassifying them.
+        MagicalContainer(vector<int> elements, vector<int> primes);
+        friend class ShardedMagicalContainer;
+        friend class SharedMagicalContainer;
 
     public:
         MagicalContainer();
+        MagicalContainer(const MagicalContainer &other) = default;
+        MagicalContainer &operator=(const MagicalContainer &other) = default;
+        // Moving hands the storage over instead of sharing it, so the target's next mutation does
+        // not copy. A moved-from container may only be assigned to or destroyed.
+        MagicalContainer(MagicalContainer &&other) noexcept = default;
+        MagicalContainer &operator=(MagicalContainer &&other) noexcept = default;
+        ~MagicalContainer() = default;
+
         void addElement(int element);
         void removeElement(int element);
+        // Adds many values in one pass: chunks are sorted, deduplicated and prime-classified on
+        // `threads` threads (0 = all hardware threads), then k-way merged into the storage.
+        void addElements(span<const int> values, size_t threads = 0);
+        // Removes many values in one pass. Unlike removeElement, values that are not present are ignored.
+        void removeElements(span<const int> values);
         size_t size() const;
         const vector<int> &getElements () const;
+        const vector<int> &getPrimes () const;
+
+        // Lazy, allocation-free range views for std::ranges pipelines, e.g.
+        //   container.ascending() | views::filter(f) | views::take(k)
+        // Like vector iterators, a view is invalidated by the next addElement/removeElement.
+        span<const int> ascending() const { return *vecElements; }
+        span<const int> primes() const { return *vecPrime; }
+        auto descending() const { return ascending() | views::reverse; }
+        auto sideCross() const {
+            span<const int> elements = ascending();
+            return views::iota(size_t{0}, elements.size()) | views::transform([elements](size_t step) {
+                return step % 2 == 0 ? elements[step / 2] : elements[elements.size() - 1 - step / 2];
+            });
+        }
+
+        // Changes whenever the elements or primes change, and is never reused within the
+        // process, not even by another container. Pointers into getElements()/getPrimes() and
+        // the range views stay valid while version() returns the value read with them.
+        uint64_t version() const { return storageVersion; }
+
+        // O(1) immutable view of the current contents; later mutations of either side do not affect the other.
+        // Storage is copy-on-write per whole vector, not per chunk: while a snapshot is alive, the
+        // first mutation that touches the elements (or the primes, or a filter index) copies that
+        // entire vector, O(n) time and memory, and later mutations are back to their usual cost.
+        MagicalContainer snapshot() const;
+
+        // Writes the elements and prime index to fd in the versioned binary format described in
+        // MagicalContainer.cpp, and reads them back. load() throws runtime_error on a bad magic,
+        // an unknown version, a checksum mismatch or a truncated file.
+        void save(int fd) const;
+        static MagicalContainer load(int fd);
+
+        // Arrow C Data Interface exchange (ArrowCData.h). The export does not copy: the
+        // ArrowArray's data buffer is the ascending storage itself, and the array keeps a
+        // reference to it until released, so later mutations leave it unchanged. Primes are
+        // marked in a bitmap built on export:
+        //   NONE      int32 array of the elements
+        //   VALIDITY  the same, with the primes valid and every other element null
+        //   COLUMN    struct<value: int32, prime: bool>
+        // The caller owns both structures and must call their release callbacks.
+        enum class ArrowPrimes { NONE, VALIDITY, COLUMN };
+        void exportArrow(ArrowSchema *schema, ArrowArray *array, ArrowPrimes primes = ArrowPrimes::COLUMN) const;
+        // Adds the non-null values of an int32 array, sorted or not, through addElements,
+        // reading them in place when the array has no nulls. Takes ownership of both
+        // structures and releases them, also when it throws runtime_error on another format.
+        void importArrow(ArrowSchema *schema, ArrowArray *array, size_t threads = 0);
+
+        // Operational counters; see MagicalStats.hpp. Build with -DMAGICAL_STATS to enable them.
+        MagicalStats stats() const;
+
+        // Starts maintaining an index of the elements matching Pred and returns its slot.
+        // Pred must be default-constructible and stateless: bool operator()(int) const.
+        // Registering the same predicate again is a no-op.
+        template <typename Pred>
+        size_t registerFilter() {
+            type_index key(typeid(Pred));
+            for (size_t slot = 0; slot < filterIndexes.size(); ++slot) {
+                if (filterIndexes[slot].predicate == key) {
+                    return slot;
+                }
+            }
+            auto values = make_shared<vector<int>>();
+            selectMatching<Pred>(*vecElements, *values);
+            filterIndexes.push_back({key, [](int value) { return Pred{}(value); }, selectMatching<Pred>, values});
+            return filterIndexes.size() - 1;
+        }
+
+        template <typename Pred>
+        const vector<int> &getFiltered() const {
+            type_index key(typeid(Pred));
+            for (const FilterIndex &index: filterIndexes) {
+                if (index.predicate == key) {
+                    return *index.values;
+                }
+            }
+            throw runtime_error("Filter is not registered");
+        }
+
+        // Range view over Pred's index, registering it first if needed.
+        template <typename Pred>
+        span<const int> filtered() {
+            return *filterIndexes[registerFilter<Pred>()].values;
+        }
+
+        enum class IteratorType { ASCENDING, SIDE_CROSS, PRIME, DESCENDING, REVERSE_SIDE_CROSS, REVERSE_PRIME, FILTERED, COMPOSED, SAMPLE };
+
+        // Traversal orders and index-backed subsets that ComposedIterator combines.
+        enum class Order { ASCENDING, DESCENDING, SIDE_CROSS };
+        enum class Subset { ALL, PRIMES, NON_PRIMES };
 
-        enum class IteratorType { ASCENDING, SIDE_CROSS, PRIME };
+    private:
+        // Rank/select over a Subset without storing it. NON_PRIMES is never materialized: its
+        // k-th member is elements[k + j], j being the number of primes before it, found by a
+        // binary search over the prime index.
+        size_t subsetSize(Subset subset) const;
+        int subsetAt(Subset subset, size_t k) const;
+
+        // Storage an ASCENDING/SIDE_CROSS (elements) or PRIME (primes) traversal reads.
+        shared_ptr<vector<int>> sequenceOf(IteratorType type) const;
+
+    public:
+        // Smallest chunk a parallel traversal hands to one thread.
+        static constexpr size_t PARALLEL_GRAIN = 4096;
+
+        // Calls fn(value) for every value an ASCENDING, PRIME or SIDE_CROSS iterator would visit,
+        // spread over `threads` threads (0 = all hardware threads) by work stealing. Calls are
+        // unordered and concurrent, so fn must be safe to run in parallel.
+        template <typename Fn>
+        void parallelForEach(IteratorType type, Fn fn, size_t threads = 0) const {
+            shared_ptr<vector<int>> storage = sequenceOf(type);
+            const vector<int> &values = *storage;
+            bool sideCross = type == IteratorType::SIDE_CROSS;
+            stealingFor(values.size(), threads, PARALLEL_GRAIN, [&](size_t, size_t begin, size_t end) {
+                for (size_t step = begin; step < end; ++step) {
+                    fn(values[sideCross ? sideCrossPosition(step, values.size()) : step]);
+                }
+            });
+        }
+
+        // Folds the same values into init with op, which must be associative: T op(T, T), with T
+        // constructible from int. Chunks are folded in parallel and their results are combined in
+        // visit order, so the result equals the serial left fold even when op is not commutative.
+        template <typename T, typename Op>
+        T parallelReduce(IteratorType type, T init, Op op, size_t threads = 0) const {
+            shared_ptr<vector<int>> storage = sequenceOf(type);
+            const vector<int> &values = *storage;
+            bool sideCross = type == IteratorType::SIDE_CROSS;
+            auto valueAt = [&](size_t step) {
+                return T(values[sideCross ? sideCrossPosition(step, values.size()) : step]);
+            };
+            mutex partialsLock;
+            vector<pair<size_t, T>> partials;
+            stealingFor(values.size(), threads, PARALLEL_GRAIN, [&](size_t, size_t begin, size_t end) {
+                T partial = valueAt(begin);
+                for (size_t step = begin + 1; step < end; ++step) {
+                    partial = op(std::move(partial), valueAt(step));
+                }
+                lock_guard<mutex> guard(partialsLock);
+                partials.emplace_back(begin, std::move(partial));
+            });
+            sort(partials.begin(), partials.end(), [](const auto &left, const auto &right) {
+                return left.first < right.first;
+            });
+            for (auto &partial: partials) {
+                init = op(std::move(init), std::move(partial.second));
+            }
+            return init;
+        }
 
         class Iterator {
         private:
@@ -159,6 +397,378 @@ namespace ariel {
             MagicalContainer &getContainer() const;
             size_t getIndex() const;
         };
+
+        class DescendingIterator : public Iterator {
+        private:
+            MagicalContainer &container;
+            size_t index;
+        public:
+            DescendingIterator();
+            DescendingIterator(MagicalContainer &container);
+            DescendingIterator(MagicalContainer &container, size_t index);
+
+            ~DescendingIterator() override;
+
+            DescendingIterator(const DescendingIterator &other);
+            DescendingIterator(DescendingIterator &&) noexcept = delete;
+            DescendingIterator &operator=(const DescendingIterator &other);
+            DescendingIterator &operator=(DescendingIterator &&) noexcept = delete;
+
+            bool operator==(const DescendingIterator &other) const;
+            bool operator!=(const DescendingIterator &other) const;
+            bool operator>(const DescendingIterator &other) const;
+            bool operator<(const DescendingIterator &other) const;
+
+            bool operator==(const Iterator &other) const override;
+            bool operator!=(const Iterator &other) const override;
+            bool operator>(const Iterator &other) const override;
+            bool operator<(const Iterator &other) const override;
+
+            int operator*() const;
+
+            DescendingIterator &operator++();
+
+            DescendingIterator begin();
+            DescendingIterator end();
+
+            MagicalContainer &getContainer() const;
+            size_t getIndex() const;
+        };
+
+        class ReverseSideCrossIterator : public Iterator {
+        private:
+            MagicalContainer &container;
+            size_t index;
+        public:
+            ReverseSideCrossIterator();
+            ReverseSideCrossIterator(MagicalContainer &container);
+            ReverseSideCrossIterator(MagicalContainer &container, size_t index);
+
+            ~ReverseSideCrossIterator() override;
+
+            ReverseSideCrossIterator(const ReverseSideCrossIterator &other);
+            ReverseSideCrossIterator(ReverseSideCrossIterator &&) noexcept = delete;
+            ReverseSideCrossIterator &operator=(const ReverseSideCrossIterator &other);
+            ReverseSideCrossIterator &operator=(ReverseSideCrossIterator &&) noexcept = delete;
+
+            bool operator==(const ReverseSideCrossIterator &other) const;
+            bool operator!=(const ReverseSideCrossIterator &other) const;
+            bool operator>(const ReverseSideCrossIterator &other) const;
+            bool operator<(const ReverseSideCrossIterator &other) const;
+
+            bool operator==(const Iterator &other) const override;
+            bool operator!=(const Iterator &other) const override;
+            bool operator>(const Iterator &other) const override;
+            bool operator<(const Iterator &other) const override;
+
+            int operator*() const;
+
+            ReverseSideCrossIterator &operator++();
+
+            ReverseSideCrossIterator begin();
+            ReverseSideCrossIterator end();
+
+            MagicalContainer &getContainer() const;
+            size_t getIndex() const;
+        };
+
+        class ReversePrimeIterator : public Iterator {
+        private:
+            MagicalContainer &container;
+            size_t index;
+        public:
+            ReversePrimeIterator();
+            ReversePrimeIterator(MagicalContainer &container);
+            ReversePrimeIterator(MagicalContainer &container, size_t index);
+
+            ~ReversePrimeIterator() override;
+
+            ReversePrimeIterator(const ReversePrimeIterator &other);
+            ReversePrimeIterator(ReversePrimeIterator &&) noexcept = delete;
+            ReversePrimeIterator &operator=(const ReversePrimeIterator &other);
+            ReversePrimeIterator &operator=(ReversePrimeIterator &&) noexcept = delete;
+
+            bool operator==(const ReversePrimeIterator &other) const;
+            bool operator!=(const ReversePrimeIterator &other) const;
+            bool operator>(const ReversePrimeIterator &other) const;
+            bool operator<(const ReversePrimeIterator &other) const;
+
+            bool operator==(const Iterator &other) const override;
+            bool operator!=(const Iterator &other) const override;
+            bool operator>(const Iterator &other) const override;
+            bool operator<(const Iterator &other) const override;
+
+            int operator*() const;
+
+            ReversePrimeIterator &operator++();
+
+            ReversePrimeIterator begin();
+            ReversePrimeIterator end();
+
+            MagicalContainer &getContainer() const;
+            size_t getIndex() const;
+        };
+
+        // Walks any Subset in any Order, e.g. the primes in side-cross order.
+        // index counts the steps taken; each step selects its position in the subset directly,
+        // so nothing is copied: ALL and PRIMES steps are O(1), NON_PRIMES steps O(log primes).
+        class ComposedIterator : public Iterator {
+        private:
+            MagicalContainer &container;
+            Order order;
+            Subset subset;
+            size_t index;
+
+            size_t position(size_t step, size_t count) const;
+            const ComposedIterator &sameComposition(const Iterator &other) const;
+
+        public:
+            ComposedIterator();
+            ComposedIterator(MagicalContainer &container, Order order, Subset subset);
+            ComposedIterator(MagicalContainer &container, Order order, Subset subset, size_t index);
+
+            ~ComposedIterator() override;
+
+            ComposedIterator(const ComposedIterator &other);
+            ComposedIterator(ComposedIterator &&) noexcept = delete;
+            ComposedIterator &operator=(const ComposedIterator &other);
+            ComposedIterator &operator=(ComposedIterator &&) noexcept = delete;
+
+            bool operator==(const ComposedIterator &other) const;
+            bool operator!=(const ComposedIterator &other) const;
+            bool operator>(const ComposedIterator &other) const;
+            bool operator<(const ComposedIterator &other) const;
+
+            bool operator==(const Iterator &other) const override;
+            bool operator!=(const Iterator &other) const override;
+            bool operator>(const Iterator &other) const override;
+            bool operator<(const Iterator &other) const override;
+
+            int operator*() const;
+
+            ComposedIterator &operator++();
+
+            ComposedIterator begin();
+            ComposedIterator end();
+
+            MagicalContainer &getContainer() const;
+            size_t getIndex() const;
+            Order getOrder() const;
+            Subset getSubset() const;
+        };
+
+        // Yields sampleCount elements of a Subset drawn uniformly at random by position in O(1)
+        // per sample. Without replacement it runs a sparse Fisher-Yates shuffle (O(k) memory) and
+        // stops early if the subset is smaller than sampleCount. The generator is a fixed
+        // splitmix64, so a seed reproduces the same samples on every platform.
+        class SampleIterator : public Iterator {
+        private:
+            MagicalContainer &container;
+            Subset subset;
+            size_t sampleCount;
+            size_t population;
+            bool withReplacement;
+            uint64_t seed;
+            uint64_t state;
+            size_t index;
+            size_t current;
+            unordered_map<size_t, size_t> swapped;
+
+            uint64_t nextRandom();
+            size_t nextBelow(size_t bound);
+            void draw();
+            SampleIterator(const SampleIterator &other, size_t index);
+
+        public:
+            SampleIterator();
+            SampleIterator(MagicalContainer &container, size_t sampleCount, uint64_t seed,
+                           bool withReplacement = false, Subset subset = Subset::ALL);
+
+            ~SampleIterator() override;
+
+            SampleIterator(const SampleIterator &other);
+            SampleIterator(SampleIterator &&) noexcept = delete;
+            SampleIterator &operator=(const SampleIterator &other);
+            SampleIterator &operator=(SampleIterator &&) noexcept = delete;
+
+            bool operator==(const SampleIterator &other) const;
+            bool operator!=(const SampleIterator &other) const;
+            bool operator>(const SampleIterator &other) const;
+            bool operator<(const SampleIterator &other) const;
+
+            bool operator==(const Iterator &other) const override;
+            bool operator!=(const Iterator &other) const override;
+            bool operator>(const Iterator &other) const override;
+            bool operator<(const Iterator &other) const override;
+
+            int operator*() const;
+
+            SampleIterator &operator++();
+
+            SampleIterator begin();
+            SampleIterator end();
+
+            MagicalContainer &getContainer() const;
+            size_t getIndex() const;
+        };
+
+        // Ascending walk over the elements matching Pred, generalizing PrimeIterator.
+        // The first FilteredIterator<Pred> on a container registers Pred's index; steps then
+        // read the index directly and never test rejected elements.
+        template <typename Pred>
+        class FilteredIterator : public Iterator {
+        private:
+            MagicalContainer &container;
+            size_t slot;
+            size_t index;
+
+            const vector<int> &values() const { return *container.filterIndexes[slot].values; }
+
+        public:
+            FilteredIterator() : FilteredIterator(*new MagicalContainer()) {}
+            FilteredIterator(MagicalContainer &container) : FilteredIterator(container, 0) {}
+            FilteredIterator(MagicalContainer &container, size_t index)
+                    : Iterator(IteratorType::FILTERED), container(container),
+                      slot(container.registerFilter<Pred>()), index(index) {}
+
+            ~FilteredIterator() override = default;
+
+            FilteredIterator(const FilteredIterator &other) = default;
+            FilteredIterator(FilteredIterator &&) noexcept = delete;
+            FilteredIterator &operator=(FilteredIterator &&) noexcept = delete;
+
+            FilteredIterator &operator=(const FilteredIterator &other) {
+                if (&container != &other.container) {
+                    container.iteratorError("Error with operator=()::FilteredIterator");
+                }
+                index = other.index;
+                return *this;
+            }
+
+            bool operator==(const FilteredIterator &other) const {
+                if (&container != &other.container) {
+                    container.iteratorError("Error with operator==()::FilteredIterator");
+                }
+                return index == other.index;
+            }
+
+            bool operator!=(const FilteredIterator &other) const {
+                return !(*this == other);
+            }
+
+            bool operator>(const FilteredIterator &other) const {
+                if (&container != &other.container) {
+                    container.iteratorError("Error with operator>()::FilteredIterator");
+                }
+                return index > other.index;
+            }
+
+            bool operator<(const FilteredIterator &other) const {
+                return !(*this > other || *this == other);
+            }
+
+            bool operator==(const Iterator &other) const override {
+                return *this == sameFilter(other);
+            }
+
+            bool operator!=(const Iterator &other) const override {
+                return *this != sameFilter(other);
+            }
+
+            bool operator>(const Iterator &other) const override {
+                return *this > sameFilter(other);
+            }
+
+            bool operator<(const Iterator &other) const override {
+                return *this < sameFilter(other);
+            }
+
+            int operator*() const {
+                if (index >= values().size()) {
+                    container.iteratorError("Error with operator*()::FilteredIterator");
+                }
+                return values()[index];
+            }
+
+            FilteredIterator &operator++() {
+                LatencyScope latency(LatencyOp::ITERATE);
+                if (++index > values().size()) {
+                    container.iteratorError("Error with operator++()::FilteredIterator");
+                }
+                return *this;
+            }
+
+            FilteredIterator begin() {
+                return {container, 0};
+            }
+
+            FilteredIterator end() {
+                return {container, values().size()};
+            }
+
+            MagicalContainer &getContainer() const {
+                return container;
+            }
+
+            size_t getIndex() const {
+                return index;
+            }
+
+        private:
+            // Iterators of other types, or filtered by another predicate, are not comparable.
+            const FilteredIterator &sameFilter(const Iterator &other) const {
+                const auto *otherFiltered = dynamic_cast<const FilteredIterator *>(&other);
+                if (otherFiltered == nullptr) {
+                    container.iteratorError("Error with comparing FilteredIterator to another iterator type");
+                }
+                return *otherFiltered;
+            }
+        };
+
+        // Value range queries over [low, high), positioned by binary search in O(log n).
+        // The iterator pairs are {first element >= low, first element >= high}.
+        pair<AscendingIterator, AscendingIterator> ascendingRange(int low, int high);
+        pair<PrimeIterator, PrimeIterator> primeRange(int low, int high);
+        size_t countRange(int low, int high) const;
+        size_t countPrimesInRange(int low, int high) const;
+
+        // Set algebra with another container, in place or into a new container. The element
+        // and prime indexes are combined with the same sorted-set operation (SIMD block
+        // intersection, or galloping search for skewed sizes), so nothing is reclassified.
+        // differenceFrom removes other's elements from this container.
+        void unionWith(const MagicalContainer &other);
+        void intersectWith(const MagicalContainer &other);
+        void differenceFrom(const MagicalContainer &other);
+        static MagicalContainer unionOf(const MagicalContainer &first, const MagicalContainer &second);
+        static MagicalContainer intersectionOf(const MagicalContainer &first, const MagicalContainer &second);
+        static MagicalContainer differenceOf(const MagicalContainer &first, const MagicalContainer &second);
+
+        // Range sum/mean over [low, high) of all elements or of the primes. With prefix sums
+        // enabled these are O(log n); otherwise the matching slice is summed directly.
+        // The prefix arrays are kept current by addElement/removeElement, whose O(n) shift
+        // already dominates the O(n - pos) prefix update.
+        void enablePrefixSums(bool enabled = true);
+        bool hasPrefixSums() const;
+        long long rangeSum(int low, int high) const;
+        long long primeRangeSum(int low, int high) const;
+        double rangeMean(int low, int high) const;
+        double primeRangeMean(int low, int high) const;
+
+        // Whole-set reductions over the contiguous storage with the SIMD kernels of Reductions.hpp.
+        // NON_PRIMES is computed as ALL minus PRIMES; sum() is O(1) while prefix sums are enabled.
+        long long sum(Subset subset = Subset::ALL) const;
+        size_t countMasked(uint32_t mask, uint32_t match, Subset subset = Subset::ALL) const;
+        // Counts of values in `bins` bins of `width` starting at `low`; values outside are ignored.
+        // Storage is sorted, so this is one binary search per bin boundary, not a pass over the data.
+        vector<uint64_t> histogram(int low, int width, size_t bins, Subset subset = Subset::ALL) const;
+
+        // Order statistics: kth(k) is the k-th smallest element (0-based, O(1)) and rank(x)
+        // the number of elements smaller than x (O(log n)); the prime variants do the same
+        // over the primes only. kth throws if k is out of range.
+        int kth(size_t k) const;
+        size_t rank(int value) const;
+        int primeKth(size_t k) const;
+        size_t primeRank(int value) const;
     };
 }
 #endif //MAGICAL_ITERATORS_MAGICALCONTAINER_HPP
\ No newline at end of file
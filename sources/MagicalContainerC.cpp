@@ -0,0 +1,131 @@
+#include "MagicalContainerC.h"
+#include "MagicalContainer.hpp"
+
+#include <algorithm>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+using namespace ariel;
+
+static_assert(sizeof(int) == sizeof(int32_t), "the C interface hands out int storage as int32_t");
+
+struct magical_container {
+    MagicalContainer container;
+};
+
+namespace {
+    thread_local std::string lastError;
+
+    // Runs body, turning any exception into MAGICAL_ERROR and its message.
+    template <typename Body>
+    int guarded(Body &&body) {
+        try {
+            return body();
+        } catch (const std::exception &error) {
+            lastError = error.what();
+        } catch (...) {
+            lastError = "unknown error";
+        }
+        return MAGICAL_ERROR;
+    }
+
+    int borrow(const magical_container *container, magical_view *view, bool primes) {
+        if (container == nullptr || view == nullptr) {
+            return MAGICAL_INVALID_ARGUMENT;
+        }
+        span<const int> values = primes ? container->container.primes() : container->container.ascending();
+        view->data = values.data();
+        view->length = values.size();
+        view->version = container->container.version();
+        return MAGICAL_OK;
+    }
+}
+
+extern "C" {
+
+uint32_t magical_abi_version(void) {
+    return MAGICAL_ABI_VERSION;
+}
+
+const char *magical_last_error(void) {
+    return lastError.c_str();
+}
+
+magical_container *magical_create(void) {
+    return new (std::nothrow) magical_container();
+}
+
+void magical_destroy(magical_container *container) {
+    delete container;
+}
+
+int magical_add(magical_container *container, int32_t value) {
+    if (container == nullptr) {
+        return MAGICAL_INVALID_ARGUMENT;
+    }
+    return guarded([&] {
+        container->container.addElement(value);
+        return MAGICAL_OK;
+    });
+}
+
+int magical_remove(magical_container *container, int32_t value) {
+    if (container == nullptr) {
+        return MAGICAL_INVALID_ARGUMENT;
+    }
+    const vector<int> &elements = container->container.getElements();
+    if (!binary_search(elements.begin(), elements.end(), value)) {
+        return MAGICAL_NOT_FOUND;
+    }
+    return guarded([&] {
+        container->container.removeElement(value);
+        return MAGICAL_OK;
+    });
+}
+
+int magical_add_many(magical_container *container, const int32_t *values, size_t count) {
+    if (container == nullptr || (values == nullptr && count > 0)) {
+        return MAGICAL_INVALID_ARGUMENT;
+    }
+    return guarded([&] {
+        container->container.addElements(span<const int>(values, count));
+        return MAGICAL_OK;
+    });
+}
+
+int magical_remove_many(magical_container *container, const int32_t *values, size_t count) {
+    if (container == nullptr || (values == nullptr && count > 0)) {
+        return MAGICAL_INVALID_ARGUMENT;
+    }
+    return guarded([&] {
+        container->container.removeElements(span<const int>(values, count));
+        return MAGICAL_OK;
+    });
+}
+
+size_t magical_size(const magical_container *container) {
+    return container == nullptr ? 0 : container->container.size();
+}
+
+size_t magical_prime_count(const magical_container *container) {
+    return container == nullptr ? 0 : container->container.getPrimes().size();
+}
+
+uint64_t magical_version(const magical_container *container) {
+    return container == nullptr ? 0 : container->container.version();
+}
+
+int magical_borrow_ascending(const magical_container *container, magical_view *view) {
+    return borrow(container, view, false);
+}
+
+int magical_borrow_primes(const magical_container *container, magical_view *view) {
+    return borrow(container, view, true);
+}
+
+int magical_view_valid(const magical_container *container, const magical_view *view) {
+    return container != nullptr && view != nullptr && view->version == container->container.version() ? 1 : 0;
+}
+
+}
@@ -0,0 +1,72 @@
+#ifndef MAGICAL_ITERATORS_MAGICALCONTAINERC_H
+#define MAGICAL_ITERATORS_MAGICALCONTAINERC_H
+
+/*
+ * C interface to ariel::MagicalContainer, for C programs and for ctypes/cffi bindings
+ * (build libmagical.so with `make shared`).
+ *
+ * Reads are zero-copy: a magical_view borrows the container's own sorted storage. A view stays
+ * valid until the next mutation of its container, and magical_view_valid() tells whether that
+ * has happened. A container handle must not be used from two threads at once.
+ *
+ * Functions returning int return a magical_status. On MAGICAL_ERROR, magical_last_error()
+ * describes the failure. No C++ exception crosses this interface.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bumped whenever a declaration below changes incompatibly. */
+#define MAGICAL_ABI_VERSION 1
+
+typedef struct magical_container magical_container;
+
+typedef enum magical_status {
+    MAGICAL_OK = 0,
+    MAGICAL_ERROR = 1,            /* see magical_last_error() */
+    MAGICAL_INVALID_ARGUMENT = 2, /* a null pointer where one is not allowed */
+    MAGICAL_NOT_FOUND = 3         /* magical_remove of a value that is not present */
+} magical_status;
+
+/* A read-only, ascending run of values borrowed from a container. */
+typedef struct magical_view {
+    const int32_t *data;
+    size_t length;
+    uint64_t version; /* the container's magical_version() when the view was taken */
+} magical_view;
+
+/* MAGICAL_ABI_VERSION of the library actually loaded. */
+uint32_t magical_abi_version(void);
+/* Message of the last MAGICAL_ERROR on the calling thread; "" if none. */
+const char *magical_last_error(void);
+
+/* NULL if out of memory. */
+magical_container *magical_create(void);
+/* Accepts NULL. Every view of the container is invalid afterwards. */
+void magical_destroy(magical_container *container);
+
+int magical_add(magical_container *container, int32_t value);
+int magical_remove(magical_container *container, int32_t value);
+/* Bulk paths: values need not be sorted or unique. Removing absent values is not an error. */
+int magical_add_many(magical_container *container, const int32_t *values, size_t count);
+int magical_remove_many(magical_container *container, const int32_t *values, size_t count);
+
+size_t magical_size(const magical_container *container);
+size_t magical_prime_count(const magical_container *container);
+/* Changes with every mutation; never repeats within the process. */
+uint64_t magical_version(const magical_container *container);
+
+/* Borrow every element, or the prime elements, in ascending order. */
+int magical_borrow_ascending(const magical_container *container, magical_view *view);
+int magical_borrow_primes(const magical_container *container, magical_view *view);
+/* 1 while the view may still be read, 0 once its container has been mutated. */
+int magical_view_valid(const magical_container *container, const magical_view *view);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* MAGICAL_ITERATORS_MAGICALCONTAINERC_H */
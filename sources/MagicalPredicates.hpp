@@ -0,0 +1,38 @@
+#ifndef MAGICAL_ITERATORS_MAGICALPREDICATES_HPP
+#define MAGICAL_ITERATORS_MAGICALPREDICATES_HPP
+
+#include <cmath>
+#include <cstdint>
+
+// Stateless predicate classes for MagicalContainer::FilteredIterator.
+namespace ariel {
+
+    struct IsEven {
+        bool operator()(int value) const { return value % 2 == 0; }
+    };
+
+    struct IsPerfectSquare {
+        bool operator()(int value) const {
+            if (value < 0) {
+                return false;
+            }
+            auto root = static_cast<int64_t>(std::sqrt(static_cast<double>(value)));
+            while (root * root > value) {
+                --root;
+            }
+            while ((root + 1) * (root + 1) <= value) {
+                ++root;
+            }
+            return root * root == value;
+        }
+    };
+
+    // Members of a fixed set of small ids in [0, 64), e.g. a tenant set.
+    template <uint64_t Mask>
+    struct InBitmask {
+        bool operator()(int value) const {
+            return value >= 0 && value < 64 && ((Mask >> value) & 1U) != 0;
+        }
+    };
+}
+#endif //MAGICAL_ITERATORS_MAGICALPREDICATES_HPP
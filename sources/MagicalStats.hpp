@@ -0,0 +1,57 @@
+#ifndef MAGICAL_ITERATORS_MAGICALSTATS_HPP
+#define MAGICAL_ITERATORS_MAGICALSTATS_HPP
+
+#include <cstdint>
+#include <string>
+
+#ifdef MAGICAL_STATS
+#include <atomic>
+#endif
+
+namespace ariel {
+
+    // Point-in-time copy of a container's operational counters, returned by MagicalContainer::stats().
+    // Counters read 0 unless the build defines MAGICAL_STATS; the byte gauges are always filled in.
+    struct MagicalStats {
+        bool enabled = false;
+        uint64_t primeChecks = 0;
+        uint64_t primeDivisions = 0;
+        uint64_t elementsShifted = 0;
+        uint64_t reallocations = 0;
+        uint64_t iteratorExceptions = 0;
+        uint64_t bytesReserved = 0;
+        uint64_t bytesUsed = 0;
+
+        std::string toJson() const;
+    };
+
+#ifdef MAGICAL_STATS
+    // Relaxed atomic counter that can be copied along with its container.
+    class StatCounter {
+    private:
+        std::atomic<uint64_t> value{0};
+
+    public:
+        StatCounter() = default;
+        ~StatCounter() = default;
+        StatCounter(const StatCounter &other) : value(other.load()) {}
+        StatCounter(StatCounter &&other) noexcept : value(other.load()) {}
+        StatCounter &operator=(const StatCounter &other) {
+            value.store(other.load(), std::memory_order_relaxed);
+            return *this;
+        }
+        StatCounter &operator=(StatCounter &&other) noexcept {
+            value.store(other.load(), std::memory_order_relaxed);
+            return *this;
+        }
+
+        void add(uint64_t amount) { value.fetch_add(amount, std::memory_order_relaxed); }
+        uint64_t load() const { return value.load(std::memory_order_relaxed); }
+    };
+
+#define MAGICAL_STAT_ADD(counters, counter, amount) (counters).counter.add(amount)
+#else
+#define MAGICAL_STAT_ADD(counters, counter, amount) ((void)0)
+#endif
+}
+#endif //MAGICAL_ITERATORS_MAGICALSTATS_HPP
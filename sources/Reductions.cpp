@@ -0,0 +1,125 @@
+#include "Reductions.hpp"
+
+#include <bit>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MAGICAL_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+    long long sumScalar(const int *values, size_t count) {
+        long long total = 0;
+        for (size_t i = 0; i < count; ++i) {
+            total += values[i];
+        }
+        return total;
+    }
+
+    size_t countScalar(const int *values, size_t count, uint32_t mask, uint32_t match) {
+        size_t matches = 0;
+        for (size_t i = 0; i < count; ++i) {
+            matches += (static_cast<uint32_t>(values[i]) & mask) == match ? 1 : 0;
+        }
+        return matches;
+    }
+
+#ifdef MAGICAL_X86_DISPATCH
+    // Widens each 8-value load to two vectors of 64-bit lanes before adding.
+    __attribute__((target("avx2")))
+    long long sumAvx2(const int *values, size_t count) {
+        __m256i low = _mm256_setzero_si256();
+        __m256i high = _mm256_setzero_si256();
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + i));
+            low = _mm256_add_epi64(low, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(block)));
+            high = _mm256_add_epi64(high, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(block, 1)));
+        }
+        alignas(32) long long lanes[4];
+        _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), _mm256_add_epi64(low, high));
+        return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sumScalar(values + i, count - i);
+    }
+
+    __attribute__((target("avx2")))
+    size_t countAvx2(const int *values, size_t count, uint32_t mask, uint32_t match) {
+        __m256i maskVector = _mm256_set1_epi32(static_cast<int>(mask));
+        __m256i matchVector = _mm256_set1_epi32(static_cast<int>(match));
+        size_t matches = 0;
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + i));
+            __m256i equal = _mm256_cmpeq_epi32(_mm256_and_si256(block, maskVector), matchVector);
+            matches += static_cast<size_t>(popcount(static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(equal)))));
+        }
+        return matches + countScalar(values + i, count - i, mask, match);
+    }
+
+    __attribute__((target("avx512f")))
+    long long sumAvx512(const int *values, size_t count) {
+        __m512i low = _mm512_setzero_si512();
+        __m512i high = _mm512_setzero_si512();
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16) {
+            __m512i block = _mm512_loadu_si512(values + i);
+            low = _mm512_add_epi64(low, _mm512_cvtepi32_epi64(_mm512_castsi512_si256(block)));
+            high = _mm512_add_epi64(high, _mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(block, 1)));
+        }
+        return _mm512_reduce_add_epi64(_mm512_add_epi64(low, high)) + sumScalar(values + i, count - i);
+    }
+
+    __attribute__((target("avx512f")))
+    size_t countAvx512(const int *values, size_t count, uint32_t mask, uint32_t match) {
+        __m512i maskVector = _mm512_set1_epi32(static_cast<int>(mask));
+        __m512i matchVector = _mm512_set1_epi32(static_cast<int>(match));
+        size_t matches = 0;
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16) {
+            __m512i block = _mm512_loadu_si512(values + i);
+            __mmask16 equal = _mm512_cmpeq_epi32_mask(_mm512_and_si512(block, maskVector), matchVector);
+            matches += static_cast<size_t>(popcount(static_cast<unsigned>(equal)));
+        }
+        return matches + countScalar(values + i, count - i, mask, match);
+    }
+#endif
+
+    struct Kernels {
+        long long (*sum)(const int *, size_t);
+        size_t (*count)(const int *, size_t, uint32_t, uint32_t);
+        const char *target;
+    };
+
+    const Kernels &kernels() {
+        static const Kernels selected = [] {
+#ifdef MAGICAL_X86_DISPATCH
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f")) {
+                return Kernels{sumAvx512, countAvx512, "avx512"};
+            }
+            if (__builtin_cpu_supports("avx2")) {
+                return Kernels{sumAvx2, countAvx2, "avx2"};
+            }
+#endif
+            return Kernels{sumScalar, countScalar, "scalar"};
+        }();
+        return selected;
+    }
+}
+
+namespace ariel {
+
+    long long sumInts(span<const int> values) {
+        return kernels().sum(values.data(), values.size());
+    }
+
+    size_t countMasked(span<const int> values, uint32_t mask, uint32_t match) {
+        return kernels().count(values.data(), values.size(), mask, match);
+    }
+
+    const char *reductionTarget() {
+        return kernels().target;
+    }
+}
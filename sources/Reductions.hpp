@@ -0,0 +1,21 @@
+#ifndef MAGICAL_ITERATORS_REDUCTIONS_HPP
+#define MAGICAL_ITERATORS_REDUCTIONS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// Reduction kernels over contiguous int storage, as kept by MagicalContainer.
+// The first call picks the widest instruction set the CPU supports (AVX-512, AVX2, scalar).
+namespace ariel {
+
+    // Sum with 64-bit accumulators, so no input size can overflow an intermediate lane.
+    long long sumInts(std::span<const int> values);
+
+    // Number of values with (value & mask) == match, e.g. mask 1, match 0 counts the even values.
+    size_t countMasked(std::span<const int> values, uint32_t mask, uint32_t match);
+
+    // "avx512", "avx2" or "scalar": the kernels selected on this machine.
+    const char *reductionTarget();
+}
+#endif //MAGICAL_ITERATORS_REDUCTIONS_HPP
@@ -0,0 +1,112 @@
+#include "SetAlgebra.hpp"
+
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+    // For each value of the smaller input, exponential search forward in the larger one.
+    size_t gallopIntersect(const int *small, size_t smallSize, const int *large, size_t largeSize, int *out) {
+        size_t count = 0;
+        size_t low = 0;
+        for (size_t i = 0; i < smallSize && low < largeSize; ++i) {
+            int target = small[i];
+            size_t bound = 1;
+            while (low + bound < largeSize && large[low + bound] < target) {
+                bound *= 2;
+            }
+            const int *found = lower_bound(large + low + bound / 2, large + min(largeSize, low + bound + 1), target);
+            low = static_cast<size_t>(found - large);
+            if (low < largeSize && *found == target) {
+                out[count++] = target;
+                ++low;
+            }
+        }
+        return count;
+    }
+
+    size_t scalarIntersect(const int *first, size_t firstSize, const int *second, size_t secondSize, int *out) {
+        return static_cast<size_t>(set_intersection(first, first + firstSize, second, second + secondSize, out) - out);
+    }
+
+#if defined(__SSE2__)
+    // Compares 4 values of each input per step: every lane of one block against all
+    // rotations of the other, then advances whichever block ends lower (both on a tie).
+    size_t blockIntersect(const int *first, size_t firstSize, const int *second, size_t secondSize, int *out) {
+        size_t count = 0;
+        size_t i = 0;
+        size_t j = 0;
+        while (i + 4 <= firstSize && j + 4 <= secondSize) {
+            __m128i left = _mm_loadu_si128(reinterpret_cast<const __m128i *>(first + i));
+            __m128i right = _mm_loadu_si128(reinterpret_cast<const __m128i *>(second + j));
+            __m128i equal = _mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi32(left, right),
+                                 _mm_cmpeq_epi32(left, _mm_shuffle_epi32(right, _MM_SHUFFLE(0, 3, 2, 1)))),
+                    _mm_or_si128(_mm_cmpeq_epi32(left, _mm_shuffle_epi32(right, _MM_SHUFFLE(1, 0, 3, 2))),
+                                 _mm_cmpeq_epi32(left, _mm_shuffle_epi32(right, _MM_SHUFFLE(2, 1, 0, 3)))));
+            auto mask = static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(equal)));
+            // Branch-free compaction: always store, only advance past matches.
+            for (unsigned lane = 0; lane < 4; ++lane) {
+                out[count] = first[i + lane];
+                count += (mask >> lane) & 1U;
+            }
+            int firstLast = first[i + 3];
+            int secondLast = second[j + 3];
+            i += firstLast <= secondLast ? 4 : 0;
+            j += secondLast <= firstLast ? 4 : 0;
+        }
+        return count + scalarIntersect(first + i, firstSize - i, second + j, secondSize - j, out + count);
+    }
+#endif
+}
+
+namespace ariel {
+
+    size_t intersectSorted(const int *first, size_t firstSize, const int *second, size_t secondSize, int *out) {
+        if (firstSize == 0 || secondSize == 0) {
+            return 0;
+        }
+        if (firstSize * GALLOP_RATIO <= secondSize) {
+            return gallopIntersect(first, firstSize, second, secondSize, out);
+        }
+        if (secondSize * GALLOP_RATIO <= firstSize) {
+            return gallopIntersect(second, secondSize, first, firstSize, out);
+        }
+#if defined(__SSE2__)
+        return blockIntersect(first, firstSize, second, secondSize, out);
+#else
+        return scalarIntersect(first, firstSize, second, secondSize, out);
+#endif
+    }
+
+    size_t unionSorted(const int *first, size_t firstSize, const int *second, size_t secondSize, int *out) {
+        return static_cast<size_t>(set_union(first, first + firstSize, second, second + secondSize, out) - out);
+    }
+
+    size_t differenceSorted(const int *first, size_t firstSize, const int *second, size_t secondSize, int *out) {
+        return static_cast<size_t>(set_difference(first, first + firstSize, second, second + secondSize, out) - out);
+    }
+
+    vector<int> intersectSorted(const vector<int> &first, const vector<int> &second) {
+        vector<int> result(min(first.size(), second.size()) + 1);
+        result.resize(intersectSorted(first.data(), first.size(), second.data(), second.size(), result.data()));
+        return result;
+    }
+
+    vector<int> unionSorted(const vector<int> &first, const vector<int> &second) {
+        vector<int> result(first.size() + second.size());
+        result.resize(unionSorted(first.data(), first.size(), second.data(), second.size(), result.data()));
+        return result;
+    }
+
+    vector<int> differenceSorted(const vector<int> &first, const vector<int> &second) {
+        vector<int> result(first.size());
+        result.resize(differenceSorted(first.data(), first.size(), second.data(), second.size(), result.data()));
+        return result;
+    }
+}
@@ -0,0 +1,25 @@
+#ifndef MAGICAL_ITERATORS_SETALGEBRA_HPP
+#define MAGICAL_ITERATORS_SETALGEBRA_HPP
+
+#include <cstddef>
+#include <vector>
+
+// Set operations on sorted, duplicate-free int arrays, as stored by MagicalContainer.
+namespace ariel {
+
+    // Inputs whose sizes differ by at least this factor are intersected by galloping
+    // search instead of a block merge.
+    constexpr size_t GALLOP_RATIO = 32;
+
+    // Each writes the result into `out` and returns its size. `out` must have room for the
+    // largest possible result; intersectSorted needs one extra slot, min(sizes) + 1, because
+    // its SIMD loop stores a candidate before knowing whether it matched.
+    size_t intersectSorted(const int *first, size_t firstSize, const int *second, size_t secondSize, int *out);
+    size_t unionSorted(const int *first, size_t firstSize, const int *second, size_t secondSize, int *out);
+    size_t differenceSorted(const int *first, size_t firstSize, const int *second, size_t secondSize, int *out);
+
+    std::vector<int> intersectSorted(const std::vector<int> &first, const std::vector<int> &second);
+    std::vector<int> unionSorted(const std::vector<int> &first, const std::vector<int> &second);
+    std::vector<int> differenceSorted(const std::vector<int> &first, const std::vector<int> &second);
+}
+#endif //MAGICAL_ITERATORS_SETALGEBRA_HPP
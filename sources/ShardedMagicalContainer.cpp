@@ -0,0 +1,458 @@
+#include "ShardedMagicalContainer.hpp"
+
+using namespace ariel;
+
+namespace {
+    // Writers only look at the skew every this many inserts into their shard.
+    constexpr size_t SKEW_CHECK_PERIOD = 256;
+}
+
+ShardedMagicalContainer::ShardedMagicalContainer(size_t shardCount, int minValue, int maxValue) {
+    if (shardCount == 0) {
+        throw runtime_error("A sharded container needs at least one shard");
+    }
+    if (minValue > maxValue) {
+        throw runtime_error("Empty value range");
+    }
+    auto span = static_cast<long long>(maxValue) - minValue + 1;
+    for (size_t i = 0; i < shardCount; ++i) {
+        shards.push_back(make_unique<Shard>());
+        if (i > 0) {
+            auto offset = span * static_cast<long long>(i) / static_cast<long long>(shardCount);
+            shards[i]->lowerBound.store(static_cast<int>(minValue + offset), memory_order_relaxed);
+        }
+    }
+}
+
+size_t ShardedMagicalContainer::shardFor(int element) const {
+    // Last shard whose lower bound is <= element; shard 0 always starts at INT_MIN.
+    size_t low = 0;
+    size_t high = shards.size();
+    while (high - low > 1) {
+        size_t middle = low + (high - low) / 2;
+        if (shards[middle]->lowerBound.load(memory_order_relaxed) <= element) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// Only meaningful with the shard's lock held, which keeps rebalance() from moving its bounds.
+bool ShardedMagicalContainer::owns(size_t shard, int element) const {
+    if (element < shards[shard]->lowerBound.load(memory_order_relaxed)) {
+        return false;
+    }
+    return shard + 1 == shards.size() || element < shards[shard + 1]->lowerBound.load(memory_order_relaxed);
+}
+
+void ShardedMagicalContainer::addElement(int element) {
+    size_t shard;
+    size_t count;
+    for (;;) {
+        shard = shardFor(element);
+        Shard &target = *shards[shard];
+        lock_guard<mutex> guard(target.lock);
+        // A rebalance may have moved the boundary between the lookup and the lock.
+        if (owns(shard, element)) {
+            target.container.addElement(element);
+            count = target.container.size();
+            target.count.store(count, memory_order_relaxed);
+            break;
+        }
+    }
+    if (count % SKEW_CHECK_PERIOD == 0) {
+        rebalanceIfSkewed(shard);
+    }
+}
+
+void ShardedMagicalContainer::removeElement(int element) {
+    for (;;) {
+        size_t shard = shardFor(element);
+        Shard &target = *shards[shard];
+        lock_guard<mutex> guard(target.lock);
+        if (owns(shard, element)) {
+            target.container.removeElement(element);
+            target.count.store(target.container.size(), memory_order_relaxed);
+            return;
+        }
+    }
+}
+
+size_t ShardedMagicalContainer::size() const {
+    size_t total = 0;
+    for (const auto &shard: shards) {
+        total += shard->count.load(memory_order_relaxed);
+    }
+    return total;
+}
+
+size_t ShardedMagicalContainer::primeCount() const {
+    size_t total = 0;
+    for (const auto &shard: shards) {
+        lock_guard<mutex> guard(shard->lock);
+        total += shard->container.getPrimes().size();
+    }
+    return total;
+}
+
+vector<size_t> ShardedMagicalContainer::shardSizes() const {
+    vector<size_t> sizes;
+    for (const auto &shard: shards) {
+        sizes.push_back(shard->count.load(memory_order_relaxed));
+    }
+    return sizes;
+}
+
+vector<int> ShardedMagicalContainer::shardLowerBounds() const {
+    vector<int> bounds;
+    for (const auto &shard: shards) {
+        bounds.push_back(shard->lowerBound.load(memory_order_relaxed));
+    }
+    return bounds;
+}
+
+void ShardedMagicalContainer::rebalanceIfSkewed(size_t shard) {
+    double limit = skewLimit.load(memory_order_relaxed);
+    auto count = static_cast<double>(shards[shard]->count.load(memory_order_relaxed));
+    if (limit <= 0 || count < MIN_REBALANCE_SIZE) {
+        return;
+    }
+    double average = static_cast<double>(size()) / static_cast<double>(shards.size());
+    if (count > limit * average) {
+        rebalance();
+    }
+}
+
+void ShardedMagicalContainer::rebalance() {
+    // Locks are always taken in shard order, so two rebalances cannot deadlock.
+    vector<unique_lock<mutex>> guards;
+    for (const auto &shard: shards) {
+        guards.emplace_back(shard->lock);
+    }
+    vector<int> elements;
+    vector<int> primes;
+    for (const auto &shard: shards) {
+        const MagicalContainer &container = shard->container;
+        elements.insert(elements.end(), container.getElements().begin(), container.getElements().end());
+        primes.insert(primes.end(), container.getPrimes().begin(), container.getPrimes().end());
+    }
+    size_t count = shards.size();
+    if (elements.size() < count) {
+        return;
+    }
+
+    auto primeBegin = primes.begin();
+    for (size_t i = 0; i < count; ++i) {
+        size_t first = elements.size() * i / count;
+        size_t last = elements.size() * (i + 1) / count;
+        auto primeEnd = i + 1 == count ? primes.end() : lower_bound(primeBegin, primes.end(), elements[last]);
+        auto begin = elements.begin() + static_cast<ptrdiff_t>(first);
+        auto end = elements.begin() + static_cast<ptrdiff_t>(last);
+        Shard &shard = *shards[i];
+        shard.container = MagicalContainer(vector<int>(begin, end), vector<int>(primeBegin, primeEnd));
+        shard.count.store(last - first, memory_order_relaxed);
+        if (i > 0) {
+            shard.lowerBound.store(elements[first], memory_order_relaxed);
+        }
+        primeBegin = primeEnd;
+    }
+    rebalances.fetch_add(1, memory_order_relaxed);
+}
+
+unique_ptr<ShardedMagicalContainer> ShardedMagicalContainer::snapshot() const {
+    auto copy = make_unique<ShardedMagicalContainer>(shards.size());
+    vector<unique_lock<mutex>> guards;
+    for (const auto &shard: shards) {
+        guards.emplace_back(shard->lock);
+    }
+    for (size_t i = 0; i < shards.size(); ++i) {
+        Shard &target = *copy->shards[i];
+        target.container = shards[i]->container.snapshot();
+        target.lowerBound.store(shards[i]->lowerBound.load(memory_order_relaxed), memory_order_relaxed);
+        target.count.store(shards[i]->count.load(memory_order_relaxed), memory_order_relaxed);
+    }
+    copy->setSkewLimit(skewLimit.load(memory_order_relaxed));
+    return copy;
+}
+
+vector<int> ShardedMagicalContainer::getElements() const {
+    vector<int> elements;
+    for (const auto &shard: shards) {
+        lock_guard<mutex> guard(shard->lock);
+        elements.insert(elements.end(), shard->container.getElements().begin(), shard->container.getElements().end());
+    }
+    return elements;
+}
+
+vector<int> ShardedMagicalContainer::getPrimes() const {
+    vector<int> primes;
+    for (const auto &shard: shards) {
+        lock_guard<mutex> guard(shard->lock);
+        primes.insert(primes.end(), shard->container.getPrimes().begin(), shard->container.getPrimes().end());
+    }
+    return primes;
+}
+
+void ShardedMagicalContainer::iteratorError(const char *message) {
+    throw runtime_error(message);
+}
+
+// ------------------------------------------------------------------------------------------
+// Cursors: the end position of either sequence is {shards.size(), 0}.
+
+static const vector<int> &valuesOf(const MagicalContainer &container, bool primes) {
+    return primes ? container.getPrimes() : container.getElements();
+}
+
+ShardedMagicalContainer::Cursor ShardedMagicalContainer::firstOf(bool primes) const {
+    Cursor cursor{0, 0};
+    while (cursor.shard < shards.size() && valuesOf(shards[cursor.shard]->container, primes).empty()) {
+        ++cursor.shard;
+    }
+    return cursor;
+}
+
+ShardedMagicalContainer::Cursor ShardedMagicalContainer::lastOf(bool primes) const {
+    for (size_t shard = shards.size(); shard-- > 0;) {
+        size_t count = valuesOf(shards[shard]->container, primes).size();
+        if (count > 0) {
+            return {shard, count - 1};
+        }
+    }
+    return {shards.size(), 0};
+}
+
+void ShardedMagicalContainer::advance(Cursor &cursor, bool primes) const {
+    ++cursor.local;
+    while (cursor.shard < shards.size() && cursor.local >= valuesOf(shards[cursor.shard]->container, primes).size()) {
+        ++cursor.shard;
+        cursor.local = 0;
+    }
+}
+
+void ShardedMagicalContainer::retreat(Cursor &cursor, bool primes) const {
+    if (cursor.local > 0) {
+        --cursor.local;
+        return;
+    }
+    while (cursor.shard-- > 0) {
+        size_t count = valuesOf(shards[cursor.shard]->container, primes).size();
+        if (count > 0) {
+            cursor.local = count - 1;
+            return;
+        }
+    }
+    cursor = {shards.size(), 0};
+}
+
+int ShardedMagicalContainer::valueAt(const Cursor &cursor, bool primes) const {
+    if (cursor.shard >= shards.size()) {
+        iteratorError("Iterator out of bound operator*()");
+    }
+    const vector<int> &values = valuesOf(shards[cursor.shard]->container, primes);
+    if (cursor.local >= values.size()) {
+        iteratorError("Iterator out of bound operator*()");
+    }
+    return values[cursor.local];
+}
+
+static bool before(size_t shard, size_t local, size_t otherShard, size_t otherLocal) {
+    return shard < otherShard || (shard == otherShard && local < otherLocal);
+}
+
+// ------------------------------------------------------------------------------------------
+// AscendingIterator
+
+ShardedMagicalContainer::AscendingIterator::AscendingIterator(const ShardedMagicalContainer &container)
+        : container(container), cursor(container.firstOf(false)) {
+}
+
+ShardedMagicalContainer::AscendingIterator::AscendingIterator(const ShardedMagicalContainer &container, Cursor cursor)
+        : container(container), cursor(cursor) {
+}
+
+ShardedMagicalContainer::AscendingIterator &ShardedMagicalContainer::AscendingIterator::operator=(const AscendingIterator &other) {
+    if (&container != &other.container) {
+        iteratorError("Error with operator=() :: AscendingIterator!!!");
+    }
+    cursor = other.cursor;
+    return *this;
+}
+
+bool ShardedMagicalContainer::AscendingIterator::operator==(const AscendingIterator &other) const {
+    if (&container != &other.container) {
+        iteratorError("Error with operator==():: AscendingIterator!!!.");
+    }
+    return cursor.shard == other.cursor.shard && cursor.local == other.cursor.local;
+}
+
+bool ShardedMagicalContainer::AscendingIterator::operator!=(const AscendingIterator &other) const {
+    return !(*this == other);
+}
+
+bool ShardedMagicalContainer::AscendingIterator::operator>(const AscendingIterator &other) const {
+    if (&container != &other.container) {
+        iteratorError("Error with operator>()::: AscendingIterator!!!.");
+    }
+    return before(other.cursor.shard, other.cursor.local, cursor.shard, cursor.local);
+}
+
+bool ShardedMagicalContainer::AscendingIterator::operator<(const AscendingIterator &other) const {
+    return !(*this > other || *this == other);
+}
+
+int ShardedMagicalContainer::AscendingIterator::operator*() const {
+    return container.valueAt(cursor, false);
+}
+
+ShardedMagicalContainer::AscendingIterator &ShardedMagicalContainer::AscendingIterator::operator++() {
+    if (cursor.shard >= container.shards.size()) {
+        iteratorError("Error with operator++() out bound");
+    }
+    container.advance(cursor, false);
+    return *this;
+}
+
+ShardedMagicalContainer::AscendingIterator ShardedMagicalContainer::AscendingIterator::begin() const {
+    return AscendingIterator(container);
+}
+
+ShardedMagicalContainer::AscendingIterator ShardedMagicalContainer::AscendingIterator::end() const {
+    return {container, Cursor{container.shards.size(), 0}};
+}
+
+// ------------------------------------------------------------------------------------------
+// PrimeIterator
+
+ShardedMagicalContainer::PrimeIterator::PrimeIterator(const ShardedMagicalContainer &container)
+        : container(container), cursor(container.firstOf(true)) {
+}
+
+ShardedMagicalContainer::PrimeIterator::PrimeIterator(const ShardedMagicalContainer &container, Cursor cursor)
+        : container(container), cursor(cursor) {
+}
+
+ShardedMagicalContainer::PrimeIterator &ShardedMagicalContainer::PrimeIterator::operator=(const PrimeIterator &other) {
+    if (&container != &other.container) {
+        iteratorError("Error with operator=() :: PrimeIterator!!!");
+    }
+    cursor = other.cursor;
+    return *this;
+}
+
+bool ShardedMagicalContainer::PrimeIterator::operator==(const PrimeIterator &other) const {
+    if (&container != &other.container) {
+        iteratorError("Error with operator==():: PrimeIterator!!!.");
+    }
+    return cursor.shard == other.cursor.shard && cursor.local == other.cursor.local;
+}
+
+bool ShardedMagicalContainer::PrimeIterator::operator!=(const PrimeIterator &other) const {
+    return !(*this == other);
+}
+
+bool ShardedMagicalContainer::PrimeIterator::operator>(const PrimeIterator &other) const {
+    if (&container != &other.container) {
+        iteratorError("Error with operator>()::: PrimeIterator!!!.");
+    }
+    return before(other.cursor.shard, other.cursor.local, cursor.shard, cursor.local);
+}
+
+bool ShardedMagicalContainer::PrimeIterator::operator<(const PrimeIterator &other) const {
+    return !(*this > other || *this == other);
+}
+
+int ShardedMagicalContainer::PrimeIterator::operator*() const {
+    return container.valueAt(cursor, true);
+}
+
+ShardedMagicalContainer::PrimeIterator &ShardedMagicalContainer::PrimeIterator::operator++() {
+    if (cursor.shard >= container.shards.size()) {
+        iteratorError("Error with operator++() out bound");
+    }
+    container.advance(cursor, true);
+    return *this;
+}
+
+ShardedMagicalContainer::PrimeIterator ShardedMagicalContainer::PrimeIterator::begin() const {
+    return PrimeIterator(container);
+}
+
+ShardedMagicalContainer::PrimeIterator ShardedMagicalContainer::PrimeIterator::end() const {
+    return {container, Cursor{container.shards.size(), 0}};
+}
+
+// ------------------------------------------------------------------------------------------
+// SideCrossIterator
+
+ShardedMagicalContainer::SideCrossIterator::SideCrossIterator(const ShardedMagicalContainer &container)
+        : container(container), front(container.firstOf(false)), back(container.lastOf(false)), step(0),
+          total(container.size()) {
+}
+
+ShardedMagicalContainer::SideCrossIterator::SideCrossIterator(const SideCrossIterator &other, size_t step)
+        : container(other.container), front(other.front), back(other.back), step(step), total(other.total) {
+}
+
+ShardedMagicalContainer::SideCrossIterator &ShardedMagicalContainer::SideCrossIterator::operator=(const SideCrossIterator &other) {
+    if (&container != &other.container) {
+        iteratorError("Error with operator=() :: SideCrossIterator!!!");
+    }
+    front = other.front;
+    back = other.back;
+    step = other.step;
+    total = other.total;
+    return *this;
+}
+
+bool ShardedMagicalContainer::SideCrossIterator::operator==(const SideCrossIterator &other) const {
+    if (&container != &other.container) {
+        iteratorError("Error with operator==():: SideCrossIterator!!!.");
+    }
+    return step == other.step;
+}
+
+bool ShardedMagicalContainer::SideCrossIterator::operator!=(const SideCrossIterator &other) const {
+    return !(*this == other);
+}
+
+bool ShardedMagicalContainer::SideCrossIterator::operator>(const SideCrossIterator &other) const {
+    if (&container != &other.container) {
+        iteratorError("Error with operator>()::: SideCrossIterator!!!.");
+    }
+    return step > other.step;
+}
+
+bool ShardedMagicalContainer::SideCrossIterator::operator<(const SideCrossIterator &other) const {
+    return !(*this > other || *this == other);
+}
+
+int ShardedMagicalContainer::SideCrossIterator::operator*() const {
+    if (step >= total) {
+        iteratorError("Iterator out of bound operator*()");
+    }
+    return container.valueAt(step % 2 == 0 ? front : back, false);
+}
+
+ShardedMagicalContainer::SideCrossIterator &ShardedMagicalContainer::SideCrossIterator::operator++() {
+    if (step >= total) {
+        iteratorError("Error with operator++() out bound");
+    }
+    if (step % 2 == 0) {
+        container.advance(front, false);
+    } else {
+        container.retreat(back, false);
+    }
+    ++step;
+    return *this;
+}
+
+ShardedMagicalContainer::SideCrossIterator ShardedMagicalContainer::SideCrossIterator::begin() const {
+    return SideCrossIterator(container);
+}
+
+ShardedMagicalContainer::SideCrossIterator ShardedMagicalContainer::SideCrossIterator::end() const {
+    return {*this, total};
+}
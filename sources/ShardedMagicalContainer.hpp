@@ -0,0 +1,167 @@
+#ifndef MAGICAL_ITERATORS_SHARDEDMAGICALCONTAINER_HPP
+#define MAGICAL_ITERATORS_SHARDEDMAGICALCONTAINER_HPP
+
+#include <atomic>
+#include <climits>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "MagicalContainer.hpp"
+
+using namespace std;
+namespace ariel {
+
+    // MagicalContainer split by value range into a fixed number of shards, each with its own
+    // storage, prime index and lock, so writers touching different ranges never contend.
+    // Shard i holds the values in [lower bound of i, lower bound of i + 1); concatenating the
+    // shards in order gives the same sorted sequence a single MagicalContainer would hold.
+    //
+    // addElement/removeElement may be called from any number of threads. The iterators read
+    // the shards without locking: iterate a snapshot(), or while no writer is running.
+    class ShardedMagicalContainer {
+    private:
+        // Cache-line aligned so neighbouring shard locks do not false-share.
+        struct alignas(64) Shard {
+            mutex lock;
+            MagicalContainer container;
+            // Only written by rebalance() while every shard lock is held.
+            atomic<int> lowerBound{INT_MIN};
+            atomic<size_t> count{0};
+        };
+        vector<unique_ptr<Shard>> shards;
+        // A shard this many times larger than the average triggers a rebalance; 0 disables it.
+        atomic<double> skewLimit{2.0};
+        atomic<size_t> rebalances{0};
+
+        size_t shardFor(int element) const;
+        bool owns(size_t shard, int element) const;
+        void rebalanceIfSkewed(size_t shard);
+        [[noreturn]] static void iteratorError(const char *message);
+
+        // Position of an iterator: element `local` of shard `shard`, skipping empty shards.
+        struct Cursor {
+            size_t shard;
+            size_t local;
+        };
+        Cursor firstOf(bool primes) const;
+        Cursor lastOf(bool primes) const;
+        void advance(Cursor &cursor, bool primes) const;
+        void retreat(Cursor &cursor, bool primes) const;
+        int valueAt(const Cursor &cursor, bool primes) const;
+
+    public:
+        static constexpr size_t MIN_REBALANCE_SIZE = 1024;
+
+        // Splits [minValue, maxValue] evenly between shardCount shards; values outside the
+        // interval go to the first or last shard until the next rebalance.
+        explicit ShardedMagicalContainer(size_t shardCount = 8, int minValue = INT_MIN, int maxValue = INT_MAX);
+        ShardedMagicalContainer(const ShardedMagicalContainer &) = delete;
+        ShardedMagicalContainer &operator=(const ShardedMagicalContainer &) = delete;
+        ~ShardedMagicalContainer() = default;
+
+        void addElement(int element);
+        void removeElement(int element);
+        size_t size() const;
+        size_t primeCount() const;
+
+        size_t shardCount() const { return shards.size(); }
+        vector<size_t> shardSizes() const;
+        vector<int> shardLowerBounds() const;
+
+        // Moves the boundaries to the element quantiles so every shard holds about size()/shardCount() values.
+        // Takes every shard lock; concurrent writers wait for it.
+        void rebalance();
+        void setSkewLimit(double factor) { skewLimit.store(factor, memory_order_relaxed); }
+        size_t rebalanceCount() const { return rebalances.load(memory_order_relaxed); }
+
+        // Consistent copy of all shards, taken under every shard lock; O(shards) thanks to copy-on-write storage.
+        unique_ptr<ShardedMagicalContainer> snapshot() const;
+
+        // Concatenation of the shards, i.e. the same vectors a single MagicalContainer would hold.
+        vector<int> getElements() const;
+        vector<int> getPrimes() const;
+
+        class AscendingIterator {
+        private:
+            const ShardedMagicalContainer &container;
+            Cursor cursor;
+        public:
+            explicit AscendingIterator(const ShardedMagicalContainer &container);
+            AscendingIterator(const ShardedMagicalContainer &container, Cursor cursor);
+            AscendingIterator(const AscendingIterator &other) = default;
+            AscendingIterator(AscendingIterator &&) noexcept = delete;
+            AscendingIterator &operator=(const AscendingIterator &other);
+            AscendingIterator &operator=(AscendingIterator &&) noexcept = delete;
+            ~AscendingIterator() = default;
+
+            bool operator==(const AscendingIterator &other) const;
+            bool operator!=(const AscendingIterator &other) const;
+            bool operator>(const AscendingIterator &other) const;
+            bool operator<(const AscendingIterator &other) const;
+
+            int operator*() const;
+            AscendingIterator &operator++();
+
+            AscendingIterator begin() const;
+            AscendingIterator end() const;
+        };
+
+        class PrimeIterator {
+        private:
+            const ShardedMagicalContainer &container;
+            Cursor cursor;
+        public:
+            explicit PrimeIterator(const ShardedMagicalContainer &container);
+            PrimeIterator(const ShardedMagicalContainer &container, Cursor cursor);
+            PrimeIterator(const PrimeIterator &other) = default;
+            PrimeIterator(PrimeIterator &&) noexcept = delete;
+            PrimeIterator &operator=(const PrimeIterator &other);
+            PrimeIterator &operator=(PrimeIterator &&) noexcept = delete;
+            ~PrimeIterator() = default;
+
+            bool operator==(const PrimeIterator &other) const;
+            bool operator!=(const PrimeIterator &other) const;
+            bool operator>(const PrimeIterator &other) const;
+            bool operator<(const PrimeIterator &other) const;
+
+            int operator*() const;
+            PrimeIterator &operator++();
+
+            PrimeIterator begin() const;
+            PrimeIterator end() const;
+        };
+
+        // Alternates between a cursor walking up from the smallest value and one walking down
+        // from the largest, crossing shard boundaries on either side.
+        class SideCrossIterator {
+        private:
+            const ShardedMagicalContainer &container;
+            Cursor front;
+            Cursor back;
+            size_t step;
+            size_t total;
+        public:
+            explicit SideCrossIterator(const ShardedMagicalContainer &container);
+            SideCrossIterator(const SideCrossIterator &other) = default;
+            SideCrossIterator(SideCrossIterator &&) noexcept = delete;
+            SideCrossIterator &operator=(const SideCrossIterator &other);
+            SideCrossIterator &operator=(SideCrossIterator &&) noexcept = delete;
+            ~SideCrossIterator() = default;
+
+            bool operator==(const SideCrossIterator &other) const;
+            bool operator!=(const SideCrossIterator &other) const;
+            bool operator>(const SideCrossIterator &other) const;
+            bool operator<(const SideCrossIterator &other) const;
+
+            int operator*() const;
+            SideCrossIterator &operator++();
+
+            SideCrossIterator begin() const;
+            SideCrossIterator end() const;
+            size_t getIndex() const { return step; }
+        private:
+            SideCrossIterator(const SideCrossIterator &other, size_t step);
+        };
+    };
+}
+#endif //MAGICAL_ITERATORS_SHARDEDMAGICALCONTAINER_HPP
@@ -0,0 +1,443 @@
+#include "SharedMagicalContainer.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace ariel;
+
+namespace {
+    constexpr uint64_t SEGMENT_MAGIC = 0x4d41474943414c31ULL; // "MAGICAL1"
+    constexpr size_t ARRAY_ALIGNMENT = 64;
+
+    size_t alignUp(size_t bytes) {
+        return (bytes + ARRAY_ALIGNMENT - 1) / ARRAY_ALIGNMENT * ARRAY_ALIGNMENT;
+    }
+
+    [[noreturn]] void systemError(const string &what) {
+        throw runtime_error(what + ": " + strerror(errno));
+    }
+}
+
+SharedMagicalContainer::SharedMagicalContainer(const string &name, size_t capacity) : name(name), writer(true) {
+    size_t arrayBytes = alignUp(capacity * sizeof(int));
+    size_t headerBytes = alignUp(sizeof(Header));
+    mappedBytes = headerBytes + 2 * arrayBytes;
+
+    int fd = shm_open(name.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0644);
+    if (fd < 0) {
+        systemError("shm_open(" + name + ")");
+    }
+    if (ftruncate(fd, static_cast<off_t>(mappedBytes)) != 0) {
+        close(fd);
+        shm_unlink(name.c_str());
+        systemError("ftruncate(" + name + ")");
+    }
+    mapping = mmap(nullptr, mappedBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        systemError("mmap(" + name + ")");
+    }
+    header = new (mapping) Header{SEGMENT_MAGIC, capacity, headerBytes, headerBytes + arrayBytes, {0}, {0}, {0}};
+    slots = capacity;
+    elementsOffset = headerBytes;
+    primesOffset = headerBytes + arrayBytes;
+}
+
+SharedMagicalContainer::SharedMagicalContainer(const string &name) : name(name), writer(false) {
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        systemError("shm_open(" + name + ")");
+    }
+    struct stat info{};
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        systemError("fstat(" + name + ")");
+    }
+    mappedBytes = static_cast<size_t>(info.st_size);
+    if (mappedBytes < sizeof(Header)) {
+        close(fd);
+        throw runtime_error("Not a MagicalContainer segment: " + name);
+    }
+    mapping = mmap(nullptr, mappedBytes, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        systemError("mmap(" + name + ")");
+    }
+    header = static_cast<Header *>(mapping);
+    slots = header->capacity;
+    elementsOffset = header->elementsOffset;
+    primesOffset = header->primesOffset;
+    // Each array must fit between its offset and the next region; dividing avoids overflow.
+    auto fits = [](uint64_t offset, uint64_t limit, uint64_t count) {
+        return offset <= limit && offset % alignof(int) == 0 && count <= (limit - offset) / sizeof(int);
+    };
+    if (header->magic != SEGMENT_MAGIC || elementsOffset < sizeof(Header) ||
+        !fits(elementsOffset, primesOffset, slots) || !fits(primesOffset, mappedBytes, slots)) {
+        munmap(mapping, mappedBytes);
+        throw runtime_error("Not a MagicalContainer segment: " + name);
+    }
+}
+
+SharedMagicalContainer::~SharedMagicalContainer() {
+    munmap(mapping, mappedBytes);
+    if (writer) {
+        shm_unlink(name.c_str());
+    }
+}
+
+const int *SharedMagicalContainer::elements() const {
+    return reinterpret_cast<const int *>(static_cast<const char *>(mapping) + elementsOffset);
+}
+
+const int *SharedMagicalContainer::primes() const {
+    return reinterpret_cast<const int *>(static_cast<const char *>(mapping) + primesOffset);
+}
+
+int *SharedMagicalContainer::writableArray(uint64_t offset) {
+    if (!writer) {
+        throw runtime_error("Shared container is mapped read-only");
+    }
+    return reinterpret_cast<int *>(static_cast<char *>(mapping) + offset);
+}
+
+void SharedMagicalContainer::beginWrite() {
+    uint64_t sequence = header->sequence.load(memory_order_relaxed);
+    header->sequence.store(sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+void SharedMagicalContainer::endWrite() {
+    header->sequence.store(header->sequence.load(memory_order_relaxed) + 1, memory_order_release);
+}
+
+void SharedMagicalContainer::insertInto(int *values, atomic<uint64_t> &count, int element) {
+    uint64_t size = count.load(memory_order_relaxed);
+    int *position = lower_bound(values, values + size, element);
+    memmove(position + 1, position, static_cast<size_t>(values + size - position) * sizeof(int));
+    *position = element;
+    count.store(size + 1, memory_order_relaxed);
+}
+
+bool SharedMagicalContainer::eraseFrom(int *values, atomic<uint64_t> &count, int element) {
+    uint64_t size = count.load(memory_order_relaxed);
+    int *position = lower_bound(values, values + size, element);
+    if (position == values + size || *position != element) {
+        return false;
+    }
+    memmove(position, position + 1, static_cast<size_t>(values + size - position - 1) * sizeof(int));
+    count.store(size - 1, memory_order_relaxed);
+    return true;
+}
+
+void SharedMagicalContainer::addElement(int element) {
+    int *values = writableArray(elementsOffset);
+    uint64_t size = header->elementCount.load(memory_order_relaxed);
+    if (binary_search(values, values + size, element)) {
+        return;
+    }
+    if (size == slots) {
+        throw runtime_error("Shared container is full");
+    }
+    uint64_t divisions = 0;
+    bool prime = MagicalContainer::primeTest(element, divisions);
+    beginWrite();
+    insertInto(values, header->elementCount, element);
+    if (prime) {
+        insertInto(writableArray(primesOffset), header->primeCount, element);
+    }
+    endWrite();
+}
+
+void SharedMagicalContainer::removeElement(int element) {
+    int *values = writableArray(elementsOffset);
+    uint64_t size = header->elementCount.load(memory_order_relaxed);
+    if (!binary_search(values, values + size, element)) {
+        throw runtime_error("No element!!!");
+    }
+    beginWrite();
+    eraseFrom(values, header->elementCount, element);
+    eraseFrom(writableArray(primesOffset), header->primeCount, element);
+    endWrite();
+}
+
+uint64_t SharedMagicalContainer::readEpoch(uint64_t &elementCount, uint64_t &primeCount) const {
+    for (;;) {
+        uint64_t sequence = header->sequence.load(memory_order_acquire);
+        if (sequence % 2 == 0) {
+            elementCount = header->elementCount.load(memory_order_relaxed);
+            primeCount = header->primeCount.load(memory_order_relaxed);
+            atomic_thread_fence(memory_order_acquire);
+            if (header->sequence.load(memory_order_relaxed) == sequence) {
+                if (elementCount > slots || primeCount > elementCount) {
+                    throw runtime_error("Corrupt shared container: " + name);
+                }
+                return sequence;
+            }
+        }
+        this_thread::yield();
+    }
+}
+
+void SharedMagicalContainer::checkEpoch(uint64_t epoch) const {
+    atomic_thread_fence(memory_order_acquire);
+    if (header->sequence.load(memory_order_relaxed) != epoch) {
+        throw runtime_error("Shared container changed during iteration");
+    }
+}
+
+size_t SharedMagicalContainer::size() const {
+    uint64_t elementCount;
+    uint64_t primeCount;
+    readEpoch(elementCount, primeCount);
+    return elementCount;
+}
+
+size_t SharedMagicalContainer::primeCount() const {
+    uint64_t elementCount;
+    uint64_t primeCount;
+    readEpoch(elementCount, primeCount);
+    return primeCount;
+}
+
+size_t SharedMagicalContainer::capacity() const {
+    return slots;
+}
+
+uint64_t SharedMagicalContainer::epoch() const {
+    uint64_t elementCount;
+    uint64_t primeCount;
+    return readEpoch(elementCount, primeCount) / 2;
+}
+
+MagicalContainer SharedMagicalContainer::snapshot() const {
+    for (;;) {
+        uint64_t elementCount;
+        uint64_t primeCount;
+        uint64_t sequence = readEpoch(elementCount, primeCount);
+        vector<int> elementCopy(elements(), elements() + elementCount);
+        vector<int> primeCopy(primes(), primes() + primeCount);
+        atomic_thread_fence(memory_order_acquire);
+        if (header->sequence.load(memory_order_relaxed) == sequence) {
+            return {std::move(elementCopy), std::move(primeCopy)};
+        }
+    }
+}
+
+// ------------------------------------------------------------------------------------------
+// AscendingIterator
+
+SharedMagicalContainer::AscendingIterator::AscendingIterator(const SharedMagicalContainer &container)
+        : container(container), count(0), index(0) {
+    uint64_t primeCount;
+    uint64_t elementCount;
+    epoch = container.readEpoch(elementCount, primeCount);
+    count = elementCount;
+}
+
+SharedMagicalContainer::AscendingIterator::AscendingIterator(const AscendingIterator &other, size_t index)
+        : container(other.container), epoch(other.epoch), count(other.count), index(index) {
+}
+
+SharedMagicalContainer::AscendingIterator &SharedMagicalContainer::AscendingIterator::operator=(const AscendingIterator &other) {
+    if (&container != &other.container) {
+        throw runtime_error("Error with operator=() :: AscendingIterator!!!");
+    }
+    epoch = other.epoch;
+    count = other.count;
+    index = other.index;
+    return *this;
+}
+
+bool SharedMagicalContainer::AscendingIterator::operator==(const AscendingIterator &other) const {
+    if (&container != &other.container) {
+        throw runtime_error("Error with operator==():: AscendingIterator!!!.");
+    }
+    return index == other.index;
+}
+
+bool SharedMagicalContainer::AscendingIterator::operator!=(const AscendingIterator &other) const {
+    return !(*this == other);
+}
+
+bool SharedMagicalContainer::AscendingIterator::operator>(const AscendingIterator &other) const {
+    if (&container != &other.container) {
+        throw runtime_error("Error with operator>()::: AscendingIterator!!!.");
+    }
+    return index > other.index;
+}
+
+bool SharedMagicalContainer::AscendingIterator::operator<(const AscendingIterator &other) const {
+    return !(*this > other || *this == other);
+}
+
+int SharedMagicalContainer::AscendingIterator::operator*() const {
+    if (index >= count) {
+        throw runtime_error("Iterator out of bound operator*()");
+    }
+    int value = container.elements()[index];
+    container.checkEpoch(epoch);
+    return value;
+}
+
+SharedMagicalContainer::AscendingIterator &SharedMagicalContainer::AscendingIterator::operator++() {
+    if (++index > count) {
+        throw runtime_error("Error with operator++() out bound");
+    }
+    return *this;
+}
+
+SharedMagicalContainer::AscendingIterator SharedMagicalContainer::AscendingIterator::begin() const {
+    return {*this, 0};
+}
+
+SharedMagicalContainer::AscendingIterator SharedMagicalContainer::AscendingIterator::end() const {
+    return {*this, count};
+}
+
+// ------------------------------------------------------------------------------------------
+// PrimeIterator
+
+SharedMagicalContainer::PrimeIterator::PrimeIterator(const SharedMagicalContainer &container)
+        : container(container), count(0), index(0) {
+    uint64_t primeCount;
+    uint64_t elementCount;
+    epoch = container.readEpoch(elementCount, primeCount);
+    count = primeCount;
+}
+
+SharedMagicalContainer::PrimeIterator::PrimeIterator(const PrimeIterator &other, size_t index)
+        : container(other.container), epoch(other.epoch), count(other.count), index(index) {
+}
+
+SharedMagicalContainer::PrimeIterator &SharedMagicalContainer::PrimeIterator::operator=(const PrimeIterator &other) {
+    if (&container != &other.container) {
+        throw runtime_error("Error with operator=() :: PrimeIterator!!!");
+    }
+    epoch = other.epoch;
+    count = other.count;
+    index = other.index;
+    return *this;
+}
+
+bool SharedMagicalContainer::PrimeIterator::operator==(const PrimeIterator &other) const {
+    if (&container != &other.container) {
+        throw runtime_error("Error with operator==():: PrimeIterator!!!.");
+    }
+    return index == other.index;
+}
+
+bool SharedMagicalContainer::PrimeIterator::operator!=(const PrimeIterator &other) const {
+    return !(*this == other);
+}
+
+bool SharedMagicalContainer::PrimeIterator::operator>(const PrimeIterator &other) const {
+    if (&container != &other.container) {
+        throw runtime_error("Error with operator>()::: PrimeIterator!!!.");
+    }
+    return index > other.index;
+}
+
+bool SharedMagicalContainer::PrimeIterator::operator<(const PrimeIterator &other) const {
+    return !(*this > other || *this == other);
+}
+
+int SharedMagicalContainer::PrimeIterator::operator*() const {
+    if (index >= count) {
+        throw runtime_error("Iterator out of bound operator*()");
+    }
+    int value = container.primes()[index];
+    container.checkEpoch(epoch);
+    return value;
+}
+
+SharedMagicalContainer::PrimeIterator &SharedMagicalContainer::PrimeIterator::operator++() {
+    if (++index > count) {
+        throw runtime_error("Error with operator++() out bound");
+    }
+    return *this;
+}
+
+SharedMagicalContainer::PrimeIterator SharedMagicalContainer::PrimeIterator::begin() const {
+    return {*this, 0};
+}
+
+SharedMagicalContainer::PrimeIterator SharedMagicalContainer::PrimeIterator::end() const {
+    return {*this, count};
+}
+
+// ------------------------------------------------------------------------------------------
+// SideCrossIterator
+
+SharedMagicalContainer::SideCrossIterator::SideCrossIterator(const SharedMagicalContainer &container)
+        : container(container), count(0), index(0) {
+    uint64_t primeCount;
+    uint64_t elementCount;
+    epoch = container.readEpoch(elementCount, primeCount);
+    count = elementCount;
+}
+
+SharedMagicalContainer::SideCrossIterator::SideCrossIterator(const SideCrossIterator &other, size_t index)
+        : container(other.container), epoch(other.epoch), count(other.count), index(index) {
+}
+
+SharedMagicalContainer::SideCrossIterator &SharedMagicalContainer::SideCrossIterator::operator=(const SideCrossIterator &other) {
+    if (&container != &other.container) {
+        throw runtime_error("Error with operator=() :: SideCrossIterator!!!");
+    }
+    epoch = other.epoch;
+    count = other.count;
+    index = other.index;
+    return *this;
+}
+
+bool SharedMagicalContainer::SideCrossIterator::operator==(const SideCrossIterator &other) const {
+    if (&container != &other.container) {
+        throw runtime_error("Error with operator==():: SideCrossIterator!!!.");
+    }
+    return index == other.index;
+}
+
+bool SharedMagicalContainer::SideCrossIterator::operator!=(const SideCrossIterator &other) const {
+    return !(*this == other);
+}
+
+bool SharedMagicalContainer::SideCrossIterator::operator>(const SideCrossIterator &other) const {
+    if (&container != &other.container) {
+        throw runtime_error("Error with operator>()::: SideCrossIterator!!!.");
+    }
+    return index > other.index;
+}
+
+bool SharedMagicalContainer::SideCrossIterator::operator<(const SideCrossIterator &other) const {
+    return !(*this > other || *this == other);
+}
+
+int SharedMagicalContainer::SideCrossIterator::operator*() const {
+    if (index >= count) {
+        throw runtime_error("Iterator out of bound operator*()");
+    }
+    int value = container.elements()[MagicalContainer::sideCrossPosition(index, count)];
+    container.checkEpoch(epoch);
+    return value;
+}
+
+SharedMagicalContainer::SideCrossIterator &SharedMagicalContainer::SideCrossIterator::operator++() {
+    if (++index > count) {
+        throw runtime_error("Error with operator++() out bound");
+    }
+    return *this;
+}
+
+SharedMagicalContainer::SideCrossIterator SharedMagicalContainer::SideCrossIterator::begin() const {
+    return {*this, 0};
+}
+
+SharedMagicalContainer::SideCrossIterator SharedMagicalContainer::SideCrossIterator::end() const {
+    return {*this, count};
+}
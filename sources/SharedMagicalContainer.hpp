@@ -0,0 +1,171 @@
+#ifndef MAGICAL_ITERATORS_SHAREDMAGICALCONTAINER_HPP
+#define MAGICAL_ITERATORS_SHAREDMAGICALCONTAINER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include "MagicalContainer.hpp"
+
+using namespace std;
+namespace ariel {
+
+    // MagicalContainer whose sorted elements and prime index live in a POSIX shared-memory
+    // segment, so several processes can read one copy.
+    //
+    // Segment layout (all positions are offsets from the start of the mapping, so every
+    // process may map it at a different address):
+    //   Header | int elements[capacity] | int primes[capacity]
+    //
+    // One process creates the segment and is its only writer. Every mutation is bracketed by
+    // a seqlock: the header sequence is odd while the arrays change. Readers map the segment
+    // read-only and iterate it in place. An iterator remembers the sequence (its epoch) when
+    // it is created, and operator* throws if a write has happened since, so a reader never
+    // returns a value from a torn or newer state. Readers that hit this start a new iterator.
+    class SharedMagicalContainer {
+    private:
+        struct Header {
+            uint64_t magic;
+            uint64_t capacity;
+            uint64_t elementsOffset;
+            uint64_t primesOffset;
+            atomic<uint64_t> sequence;
+            atomic<uint64_t> elementCount;
+            atomic<uint64_t> primeCount;
+        };
+        static_assert(atomic<uint64_t>::is_always_lock_free, "seqlock needs lock-free 64-bit atomics across processes");
+
+        string name;
+        bool writer;
+        size_t mappedBytes = 0;
+        void *mapping = nullptr;
+        Header *header = nullptr;
+        // The layout as validated when mapping, so a foreign writer cannot move it afterwards.
+        uint64_t slots = 0;
+        uint64_t elementsOffset = 0;
+        uint64_t primesOffset = 0;
+
+        const int *elements() const;
+        const int *primes() const;
+        int *writableArray(uint64_t offset);
+        static void insertInto(int *values, atomic<uint64_t> &count, int element);
+        static bool eraseFrom(int *values, atomic<uint64_t> &count, int element);
+        void beginWrite();
+        void endWrite();
+        // Waits out any write in progress and returns the (even) sequence with the counts read under it.
+        // Throws if a count exceeds the capacity, which only a corrupt segment can publish.
+        uint64_t readEpoch(uint64_t &elementCount, uint64_t &primeCount) const;
+        void checkEpoch(uint64_t epoch) const;
+
+    public:
+        // Creates (or replaces) the segment `name` (e.g. "/magical") with room for `capacity`
+        // elements and maps it read-write. The writer unlinks the name when destroyed; mappings
+        // that readers already hold stay valid.
+        SharedMagicalContainer(const string &name, size_t capacity);
+        // Maps an existing segment read-only. Throws if its header does not describe two
+        // disjoint arrays inside the mapping.
+        explicit SharedMagicalContainer(const string &name);
+        SharedMagicalContainer(const SharedMagicalContainer &) = delete;
+        SharedMagicalContainer &operator=(const SharedMagicalContainer &) = delete;
+        ~SharedMagicalContainer();
+
+        void addElement(int element);
+        void removeElement(int element);
+        size_t size() const;
+        size_t primeCount() const;
+        size_t capacity() const;
+        bool isWriter() const { return writer; }
+        // Number of completed writes; changes whenever the contents do.
+        uint64_t epoch() const;
+
+        // Consistent copy of the contents, retried until no write overlapped it.
+        MagicalContainer snapshot() const;
+
+        class AscendingIterator {
+        private:
+            const SharedMagicalContainer &container;
+            uint64_t epoch;
+            size_t count;
+            size_t index;
+        public:
+            explicit AscendingIterator(const SharedMagicalContainer &container);
+            AscendingIterator(const AscendingIterator &other) = default;
+            AscendingIterator(AscendingIterator &&) noexcept = delete;
+            AscendingIterator &operator=(const AscendingIterator &other);
+            AscendingIterator &operator=(AscendingIterator &&) noexcept = delete;
+            ~AscendingIterator() = default;
+
+            bool operator==(const AscendingIterator &other) const;
+            bool operator!=(const AscendingIterator &other) const;
+            bool operator>(const AscendingIterator &other) const;
+            bool operator<(const AscendingIterator &other) const;
+
+            int operator*() const;
+            AscendingIterator &operator++();
+
+            AscendingIterator begin() const;
+            AscendingIterator end() const;
+            size_t getIndex() const { return index; }
+        private:
+            AscendingIterator(const AscendingIterator &other, size_t index);
+        };
+
+        class PrimeIterator {
+        private:
+            const SharedMagicalContainer &container;
+            uint64_t epoch;
+            size_t count;
+            size_t index;
+        public:
+            explicit PrimeIterator(const SharedMagicalContainer &container);
+            PrimeIterator(const PrimeIterator &other) = default;
+            PrimeIterator(PrimeIterator &&) noexcept = delete;
+            PrimeIterator &operator=(const PrimeIterator &other);
+            PrimeIterator &operator=(PrimeIterator &&) noexcept = delete;
+            ~PrimeIterator() = default;
+
+            bool operator==(const PrimeIterator &other) const;
+            bool operator!=(const PrimeIterator &other) const;
+            bool operator>(const PrimeIterator &other) const;
+            bool operator<(const PrimeIterator &other) const;
+
+            int operator*() const;
+            PrimeIterator &operator++();
+
+            PrimeIterator begin() const;
+            PrimeIterator end() const;
+            size_t getIndex() const { return index; }
+        private:
+            PrimeIterator(const PrimeIterator &other, size_t index);
+        };
+
+        class SideCrossIterator {
+        private:
+            const SharedMagicalContainer &container;
+            uint64_t epoch;
+            size_t count;
+            size_t index;
+        public:
+            explicit SideCrossIterator(const SharedMagicalContainer &container);
+            SideCrossIterator(const SideCrossIterator &other) = default;
+            SideCrossIterator(SideCrossIterator &&) noexcept = delete;
+            SideCrossIterator &operator=(const SideCrossIterator &other);
+            SideCrossIterator &operator=(SideCrossIterator &&) noexcept = delete;
+            ~SideCrossIterator() = default;
+
+            bool operator==(const SideCrossIterator &other) const;
+            bool operator!=(const SideCrossIterator &other) const;
+            bool operator>(const SideCrossIterator &other) const;
+            bool operator<(const SideCrossIterator &other) const;
+
+            int operator*() const;
+            SideCrossIterator &operator++();
+
+            SideCrossIterator begin() const;
+            SideCrossIterator end() const;
+            size_t getIndex() const { return index; }
+        private:
+            SideCrossIterator(const SideCrossIterator &other, size_t index);
+        };
+    };
+}
+#endif //MAGICAL_ITERATORS_SHAREDMAGICALCONTAINER_HPP
@@ -0,0 +1,318 @@
+#include "WriteAheadLog.hpp"
+#include "Codec.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <stdexcept>
+#include <unistd.h>
+
+using namespace ariel;
+using namespace std;
+
+namespace {
+    constexpr size_t FRAME_HEADER_BYTES = 8;
+    constexpr size_t RECORD_BYTES = 5;
+
+    [[noreturn]] void systemError(const string &what) {
+        throw runtime_error(what + ": " + strerror(errno));
+    }
+
+    // Reads the whole file; a missing file reads as empty.
+    vector<uint8_t> readFile(const string &path) {
+        vector<uint8_t> contents;
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            if (errno == ENOENT) {
+                return contents;
+            }
+            systemError("open(" + path + ")");
+        }
+        uint8_t chunk[1 << 16];
+        for (;;) {
+            ssize_t got = ::read(fd, chunk, sizeof(chunk));
+            if (got < 0 && errno == EINTR) {
+                continue;
+            }
+            if (got < 0) {
+                close(fd);
+                systemError("read(" + path + ")");
+            }
+            if (got == 0) {
+                break;
+            }
+            contents.insert(contents.end(), chunk, chunk + got);
+        }
+        close(fd);
+        return contents;
+    }
+
+    // Walks the intact frames of a log image and returns the length they cover.
+    size_t scanFrames(const vector<uint8_t> &contents, const function<void(const vector<LogRecord> &)> &apply,
+                      size_t &records) {
+        size_t offset = 0;
+        vector<LogRecord> frame;
+        while (contents.size() - offset >= FRAME_HEADER_BYTES) {
+            uint32_t payloadBytes;
+            uint32_t crc;
+            memcpy(&payloadBytes, contents.data() + offset, 4);
+            memcpy(&crc, contents.data() + offset + 4, 4);
+            const uint8_t *payload = contents.data() + offset + FRAME_HEADER_BYTES;
+            if (payloadBytes % RECORD_BYTES != 0 || payloadBytes > contents.size() - offset - FRAME_HEADER_BYTES ||
+                crc32c(payload, payloadBytes) != crc) {
+                break;
+            }
+            frame.clear();
+            for (size_t at = 0; at < payloadBytes; at += RECORD_BYTES) {
+                LogRecord record{static_cast<LogOp>(payload[at]), 0};
+                memcpy(&record.value, payload + at + 1, 4);
+                frame.push_back(record);
+            }
+            apply(frame);
+            records += frame.size();
+            offset += FRAME_HEADER_BYTES + payloadBytes;
+        }
+        return offset;
+    }
+
+    void writeAll(int fd, const uint8_t *data, size_t size) {
+        while (size > 0) {
+            ssize_t written = write(fd, data, size);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                systemError("write(log)");
+            }
+            data += written;
+            size -= static_cast<size_t>(written);
+        }
+    }
+
+    // Opens a log file for appending after its last intact frame. The directory is synced as
+    // well, since fdatasync() on the file alone does not make a newly created entry durable.
+    int openForAppend(const string &path) {
+        size_t records = 0;
+        size_t intact = scanFrames(readFile(path), [](const vector<LogRecord> &) {}, records);
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd < 0) {
+            systemError("open(" + path + ")");
+        }
+        if (ftruncate(fd, static_cast<off_t>(intact)) != 0) {
+            close(fd);
+            systemError("ftruncate(" + path + ")");
+        }
+        string parent = filesystem::path(path).parent_path().string();
+        try {
+            syncDirectory(parent.empty() ? "." : parent);
+        } catch (...) {
+            close(fd);
+            throw;
+        }
+        return fd;
+    }
+
+    void writeFrame(int fd, vector<uint8_t> &frame) {
+        auto payloadBytes = static_cast<uint32_t>(frame.size() - FRAME_HEADER_BYTES);
+        uint32_t crc = crc32c(frame.data() + FRAME_HEADER_BYTES, payloadBytes);
+        memcpy(frame.data(), &payloadBytes, 4);
+        memcpy(frame.data() + 4, &crc, 4);
+        writeAll(fd, frame.data(), frame.size());
+        if (fdatasync(fd) != 0) {
+            systemError("fdatasync(log)");
+        }
+    }
+}
+
+void ariel::syncDirectory(const string &directory) {
+    int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        systemError("open(" + directory + ")");
+    }
+    int result = fsync(fd);
+    close(fd);
+    if (result != 0) {
+        systemError("fsync(" + directory + ")");
+    }
+}
+
+WriteAheadLog::WriteAheadLog(const string &path, Options options)
+        : path(path), options(options), fd(openForAppend(path)) {
+    pending.resize(FRAME_HEADER_BYTES);
+    flusher = thread(&WriteAheadLog::flushLoop, this);
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    flusherWake.notify_one();
+    flusher.join();
+    // Only left behind if the flusher stopped on an I/O error.
+    for (const Retired &file: retired) {
+        close(file.fd);
+    }
+    close(fd);
+}
+
+uint64_t WriteAheadLog::append(LogOp op, int value) {
+    return append(op, span<const int>(&value, 1));
+}
+
+uint64_t WriteAheadLog::append(LogOp op, span<const int> values) {
+    lock_guard<mutex> guard(lock);
+    rethrowFailure();
+    if (values.empty()) {
+        return nextSequence - 1;
+    }
+    if (pendingRecords == 0) {
+        oldestPending = chrono::steady_clock::now();
+    }
+    size_t at = pending.size();
+    pending.resize(at + RECORD_BYTES * values.size());
+    for (int value: values) {
+        pending[at] = static_cast<uint8_t>(op);
+        memcpy(pending.data() + at + 1, &value, 4);
+        at += RECORD_BYTES;
+    }
+    // The flusher sleeps until a batch starts, then until it fills or its budget runs out.
+    size_t before = pendingRecords;
+    pendingRecords += values.size();
+    if (before == 0 || (before < options.batchRecords && pendingRecords >= options.batchRecords)) {
+        flusherWake.notify_one();
+    }
+    nextSequence += values.size();
+    return nextSequence - 1;
+}
+
+void WriteAheadLog::flushLoop() {
+    vector<Retired> closing;
+    vector<uint8_t> frame;
+    unique_lock<mutex> guard(lock);
+    for (;;) {
+        flusherWake.wait(guard, [this] {
+            return stopping || flushRequested || pendingRecords > 0 || !retired.empty();
+        });
+        flusherWake.wait_until(guard, oldestPending + options.latencyBudget, [this] {
+            return stopping || flushRequested || pendingRecords >= options.batchRecords || !retired.empty();
+        });
+        if (pendingRecords == 0 && retired.empty()) {
+            flushRequested = false;
+            durableWake.notify_all();
+            if (stopping) {
+                return;
+            }
+            continue;
+        }
+        closing.swap(retired);
+        frame.swap(pending);
+        pending.assign(FRAME_HEADER_BYTES, 0);
+        bool hasRecords = pendingRecords > 0;
+        int target = fd;
+        uint64_t last = nextSequence - 1;
+        pendingRecords = 0;
+        flushRequested = false;
+        guard.unlock();
+
+        try {
+            for (Retired &file: closing) {
+                if (file.frame.size() > FRAME_HEADER_BYTES) {
+                    writeFrame(file.fd, file.frame);
+                }
+                close(file.fd);
+                file.fd = -1;
+            }
+            closing.clear();
+            if (hasRecords) {
+                writeFrame(target, frame);
+            }
+            guard.lock();
+            durableSequence = last;
+            ++syncs;
+        } catch (...) {
+            guard.lock();
+            failure = current_exception();
+        }
+        durableWake.notify_all();
+        if (failure) {
+            for (const Retired &file: closing) {
+                if (file.fd >= 0) {
+                    close(file.fd);
+                }
+            }
+            return;
+        }
+    }
+}
+
+void WriteAheadLog::rethrowFailure() const {
+    if (failure) {
+        rethrow_exception(failure);
+    }
+}
+
+void WriteAheadLog::waitDurable(uint64_t sequence) const {
+    unique_lock<mutex> guard(lock);
+    durableWake.wait(guard, [&] { return durableSequence >= sequence || failure; });
+    rethrowFailure();
+}
+
+void WriteAheadLog::sync() {
+    uint64_t last;
+    {
+        lock_guard<mutex> guard(lock);
+        rethrowFailure();
+        last = nextSequence - 1;
+        flushRequested = true;
+    }
+    flusherWake.notify_one();
+    waitDurable(last);
+}
+
+uint64_t WriteAheadLog::rotate(const string &newPath) {
+    int newFd = openForAppend(newPath);
+    uint64_t last;
+    {
+        lock_guard<mutex> guard(lock);
+        if (failure) {
+            close(newFd);
+            rethrow_exception(failure);
+        }
+        retired.push_back({fd, std::move(pending)});
+        pending.assign(FRAME_HEADER_BYTES, 0);
+        pendingRecords = 0;
+        fd = newFd;
+        path = newPath;
+        last = nextSequence - 1;
+    }
+    flusherWake.notify_one();
+    return last;
+}
+
+string WriteAheadLog::getPath() const {
+    lock_guard<mutex> guard(lock);
+    return path;
+}
+
+uint64_t WriteAheadLog::lastSequence() const {
+    lock_guard<mutex> guard(lock);
+    return nextSequence - 1;
+}
+
+uint64_t WriteAheadLog::durable() const {
+    lock_guard<mutex> guard(lock);
+    return durableSequence;
+}
+
+uint64_t WriteAheadLog::syncCount() const {
+    lock_guard<mutex> guard(lock);
+    return syncs;
+}
+
+size_t WriteAheadLog::read(const string &path, const function<void(const vector<LogRecord> &)> &apply) {
+    size_t records = 0;
+    scanFrames(readFile(path), apply, records);
+    return records;
+}
@@ -0,0 +1,108 @@
+#ifndef MAGICAL_ITERATORS_WRITEAHEADLOG_HPP
+#define MAGICAL_ITERATORS_WRITEAHEADLOG_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ariel {
+
+    enum class LogOp : uint8_t { ADD = 1, REMOVE = 2 };
+
+    struct LogRecord {
+        LogOp op;
+        int value;
+    };
+
+    // Append-only log of container mutations with group commit.
+    //
+    // append() only copies the record into a memory buffer. A background thread writes the
+    // buffer as one frame and fdatasync()s it once `batchRecords` records are pending or the
+    // oldest of them has waited `latencyBudget`, whichever comes first. So one fsync covers
+    // a whole batch, and a record is durable at most about latencyBudget plus one fsync after
+    // it was appended.
+    //
+    // Frame: u32 payload bytes, u32 CRC-32C of the payload, then 5 bytes per record (u8 op,
+    // i32 value). A frame cut short by a crash fails its length or CRC check. Reading stops
+    // there, and reopening the log for appending truncates the file to the last whole frame.
+    //
+    // rotate() moves appending to a new file. The flusher still finishes the old file first,
+    // so records reach disk in sequence order across files. Opening a file, whether in the
+    // constructor or in rotate(), also syncs its directory, so its entry is durable before any
+    // of its records are.
+    class WriteAheadLog {
+    public:
+        struct Options {
+            std::chrono::microseconds latencyBudget{1000};
+            size_t batchRecords = 4096;
+        };
+
+    private:
+        std::string path;
+        Options options;
+        int fd = -1;
+
+        mutable std::mutex lock;
+        std::condition_variable flusherWake;
+        mutable std::condition_variable durableWake;
+        // Last frames of files retired by rotate(), written and closed before `pending`.
+        struct Retired {
+            int fd;
+            std::vector<uint8_t> frame;
+        };
+        std::vector<Retired> retired;
+        std::vector<uint8_t> pending;
+        size_t pendingRecords = 0;
+        std::chrono::steady_clock::time_point oldestPending;
+        uint64_t nextSequence = 1;
+        uint64_t durableSequence = 0;
+        uint64_t syncs = 0;
+        bool flushRequested = false;
+        bool stopping = false;
+        std::exception_ptr failure;
+        std::thread flusher;
+
+        void flushLoop();
+        void rethrowFailure() const;
+
+    public:
+        // Opens (creating if needed) the log at `path` for appending, dropping any torn frame at its end.
+        WriteAheadLog(const std::string &path, Options options);
+        WriteAheadLog(const std::string &path) : WriteAheadLog(path, Options()) {}
+        WriteAheadLog(const WriteAheadLog &) = delete;
+        WriteAheadLog &operator=(const WriteAheadLog &) = delete;
+        // Makes every appended record durable before closing.
+        ~WriteAheadLog();
+
+        // Queues a record and returns its sequence number; does not wait for the disk.
+        uint64_t append(LogOp op, int value);
+        // Queues one record per value under a single lock and returns the last sequence number.
+        uint64_t append(LogOp op, std::span<const int> values);
+        // Blocks until the record with this sequence number, and all before it, are durable.
+        void waitDurable(uint64_t sequence) const;
+        // Writes and syncs everything appended so far.
+        void sync();
+        // Appends to `newPath` from now on and returns the last sequence number written to the old file.
+        uint64_t rotate(const std::string &newPath);
+
+        uint64_t lastSequence() const;
+        uint64_t durable() const;
+        uint64_t syncCount() const;
+        std::string getPath() const;
+
+        // Calls apply once per intact frame of the log at `path`, in order, and returns the
+        // number of records read. A missing file holds no records.
+        static size_t read(const std::string &path, const std::function<void(const std::vector<LogRecord> &)> &apply);
+    };
+
+    // fsync()s a directory, so that a file created or renamed in it survives a crash.
+    void syncDirectory(const std::string &directory);
+}
+#endif //MAGICAL_ITERATORS_WRITEAHEADLOG_HPP